@@ -0,0 +1,103 @@
+# Profile guided optimization. With ENABLE_PGO, freq is built with
+# instrumentation in a nested build tree, run on the test_cases corpus
+# by PGOTraining.cmake, and the given targets are compiled with the
+# collected profile and link time optimization.
+# The nested build is configured with PGO_INSTRUMENT_DIR, the directory
+# the instrumented binary writes its profile to.
+
+if (NOT CMAKE_CXX_COMPILER_ID MATCHES "GNU|Clang")
+    message(FATAL_ERROR "ENABLE_PGO needs GCC or Clang")
+endif ()
+
+# Profiles only match code built with the same optimization flags.
+if (NOT CMAKE_BUILD_TYPE)
+    set(CMAKE_BUILD_TYPE Release)
+endif ()
+
+set(PGO_TRAINING_DIR ${CMAKE_SOURCE_DIR}/test_cases CACHE PATH "Inputs of the PGO training run")
+
+if (CMAKE_CXX_COMPILER_ID STREQUAL "Clang")
+    get_filename_component(PGO_COMPILER_DIR ${CMAKE_CXX_COMPILER} DIRECTORY)
+    find_program(LLVM_PROFDATA llvm-profdata HINTS ${PGO_COMPILER_DIR})
+    if (NOT LLVM_PROFDATA)
+        message(FATAL_ERROR "ENABLE_PGO with Clang needs llvm-profdata")
+    endif ()
+endif ()
+
+# Nested build: targets write profiles to PGO_INSTRUMENT_DIR. GCC names
+# profiles after object paths, which are kept relative to the build tree
+# so that they match in both builds.
+function(pgo_instrument)
+    foreach (target ${ARGN})
+        if (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+            target_compile_options(${target} PRIVATE
+                    -fprofile-generate=${PGO_INSTRUMENT_DIR}
+                    -fprofile-prefix-path=${CMAKE_BINARY_DIR}
+                    -fprofile-update=atomic)
+        else ()
+            target_compile_options(${target} PRIVATE
+                    -fprofile-generate=${PGO_INSTRUMENT_DIR}
+                    -fprofile-update=atomic)
+        endif ()
+        target_link_options(${target} PRIVATE -fprofile-generate=${PGO_INSTRUMENT_DIR})
+    endforeach ()
+endfunction()
+
+# Main build: targets are compiled after the training run, and again whenever it is repeated.
+function(pgo_optimize)
+    include(ExternalProject)
+    set(instrumented_dir ${CMAKE_BINARY_DIR}/pgo-instrumented)
+    set(profile_dir ${CMAKE_BINARY_DIR}/pgo-profile)
+    set(stamp ${profile_dir}/trained.stamp)
+
+    ExternalProject_Add(pgo_instrumented
+            SOURCE_DIR ${CMAKE_SOURCE_DIR}
+            BINARY_DIR ${instrumented_dir}
+            CMAKE_ARGS
+            -DCMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE}
+            -DCMAKE_CXX_COMPILER=${CMAKE_CXX_COMPILER}
+            -DCMAKE_CXX_FLAGS=${CMAKE_CXX_FLAGS}
+            -DPGO_INSTRUMENT_DIR=${profile_dir}
+            BUILD_COMMAND ${CMAKE_COMMAND} --build ${instrumented_dir} --target freq
+            BUILD_BYPRODUCTS ${instrumented_dir}/freq
+            INSTALL_COMMAND ""
+            BUILD_ALWAYS ON)
+
+    add_custom_command(OUTPUT ${stamp}
+            COMMAND ${CMAKE_COMMAND}
+            -DFREQ=${instrumented_dir}/freq
+            -DINPUT_DIR=${PGO_TRAINING_DIR}
+            -DPROFILE_DIR=${profile_dir}
+            -DLLVM_PROFDATA=${LLVM_PROFDATA}
+            -DHAS_AIO=${LIBAIO_FOUND}
+            -DSTAMP=${stamp}
+            -P ${CMAKE_SOURCE_DIR}/cmake/PGOTraining.cmake
+            DEPENDS ${instrumented_dir}/freq ${CMAKE_SOURCE_DIR}/cmake/PGOTraining.cmake
+            COMMENT "Training freq for PGO on ${PGO_TRAINING_DIR}")
+    add_custom_target(pgo_training DEPENDS ${stamp})
+    add_dependencies(pgo_training pgo_instrumented)
+
+    if (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        set(use_options
+                -fprofile-use=${profile_dir}
+                -fprofile-prefix-path=${CMAKE_BINARY_DIR}
+                -fprofile-partial-training
+                -Wno-missing-profile)
+    else ()
+        set(use_options
+                -fprofile-use=${profile_dir}/freq.profdata
+                -Wno-profile-instr-unprofiled
+                -Wno-profile-instr-out-of-date)
+    endif ()
+
+    foreach (target ${ARGN})
+        add_dependencies(${target} pgo_training)
+        target_compile_options(${target} PRIVATE ${use_options})
+        get_target_property(sources ${target} SOURCES)
+        foreach (source ${sources})
+            if (source MATCHES "\\.cpp$")
+                set_property(SOURCE ${source} APPEND PROPERTY OBJECT_DEPENDS ${stamp})
+            endif ()
+        endforeach ()
+    endforeach ()
+endfunction()
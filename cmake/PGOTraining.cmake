@@ -0,0 +1,91 @@
+# Runs the instrumented freq on the training corpus, with every engine built
+# and both backends, and with the counting modes, and prepares the profile for
+# the optimized build. Invoked by cmake/PGO.cmake with FREQ, INPUT_DIR,
+# PROFILE_DIR, STAMP, HAS_AIO and, for Clang, LLVM_PROFDATA.
+
+# Larger inputs take long under instrumentation and add nothing to the profile.
+set(max_input_size 33554432)
+
+file(GLOB inputs ${INPUT_DIR}/*/test-100000.txt ${INPUT_DIR}/*/test-1000000.txt)
+set(training_inputs)
+foreach (input ${inputs})
+    file(SIZE ${input} size)
+    if (size LESS_EQUAL max_input_size)
+        list(APPEND training_inputs ${input})
+    endif ()
+endforeach ()
+if (NOT training_inputs)
+    message(FATAL_ERROR "No training inputs in ${INPUT_DIR}, generate them with test_cases/generate_tests.py")
+endif ()
+
+# Profiles of earlier runs would be added up with this one.
+file(GLOB old_profiles ${PROFILE_DIR}/*.gcda ${PROFILE_DIR}/*.profraw ${PROFILE_DIR}/*.profdata)
+if (old_profiles)
+    file(REMOVE ${old_profiles})
+endif ()
+
+# mmap is only built with ENABLE_FILE_MUTATION, which the CMake build never sets.
+set(runs
+        "--engine=blocking"
+        "--engine=pipelined"
+        "--engine=direct"
+        "--engine=dummy"
+        "--engine=blocking --order=alpha --prefix=a"
+        "--backend=tree"
+        "--backend=tree --order=alpha"
+        "--max-memory=4M"
+        "--df"
+        "--lossy=0.001"
+        "--sample=0.5")
+if (HAS_AIO)
+    list(APPEND runs "--engine=aio")
+endif ()
+
+# The corpus has neither timestamps nor columns: windowed and field counts
+# run on records of its text, one a second, after a timestamp and a tab.
+list(GET training_inputs 0 corpus)
+file(READ ${corpus} text LIMIT 262144)
+string(REPLACE ";" " " text "${text}")
+string(LENGTH "${text}" text_size)
+set(log ${PROFILE_DIR}/training-log.tsv)
+set(records "")
+set(time 1700000000)
+foreach (begin RANGE 0 ${text_size} 64)
+    string(SUBSTRING "${text}" ${begin} 64 record)
+    string(APPEND records "${time}\t${record}\n")
+    math(EXPR time "${time} + 1")
+endforeach ()
+file(WRITE ${log} "${records}")
+set(log_runs
+        "--window=5m --top=20"
+        "--field=2")
+
+set(output ${PROFILE_DIR}/training-output.txt)
+foreach (input ${training_inputs})
+    foreach (run ${runs})
+        separate_arguments(options UNIX_COMMAND ${run})
+        execute_process(COMMAND ${FREQ} ${options} ${input} ${output} RESULT_VARIABLE result)
+        if (NOT result EQUAL 0)
+            message(FATAL_ERROR "Training run failed: freq ${run} ${input}")
+        endif ()
+    endforeach ()
+endforeach ()
+foreach (run ${log_runs})
+    separate_arguments(options UNIX_COMMAND ${run})
+    execute_process(COMMAND ${FREQ} ${options} ${log} ${output} RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Training run failed: freq ${run} ${log}")
+    endif ()
+endforeach ()
+file(REMOVE ${output} ${log})
+
+if (LLVM_PROFDATA)
+    file(GLOB raw_profiles ${PROFILE_DIR}/*.profraw)
+    execute_process(COMMAND ${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/freq.profdata ${raw_profiles}
+            RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Cannot merge profiles in ${PROFILE_DIR}")
+    endif ()
+endif ()
+
+file(TOUCH ${STAMP})
@@ -5,6 +5,9 @@
 
 #include "../src/freq.h"
 #include "../src/dummy/freq_dummy.h"
+#ifdef ENABLE_PERF_COUNTERS
+#include "PerfCounters.h"
+#endif
 
 #define BASE_FREQ_BENCHMARK(TARGET, FUNCTION, TEST_DIR) \
     BENCHMARK_CAPTURE(TARGET, TEST_DIR, FUNCTION, #TEST_DIR) \
@@ -27,13 +30,63 @@ constexpr size_t ITERATIONS = 3;
 constexpr size_t FILES_RANGE_START = files.size() - 1; // default 0;
 constexpr size_t FILES_RANGE_END = files.size() - 1;
 
+#ifdef ENABLE_PERF_COUNTERS
+static void report_perf_counters(benchmark::State &state,
+                                 const PerfCounters &counters,
+                                 const PerfCounters::Values &values,
+                                 size_t bytes, size_t words) {
+    for (size_t i = 0; i < PerfCounters::EVENTS_COUNT; ++i) {
+        const auto event = static_cast<PerfCounters::Event>(i);
+        if (!counters.available(event)) {
+            continue;
+        }
+        const std::string name(PerfCounters::names[i]);
+        state.counters[name + "/byte"] = static_cast<double>(values[i]) / static_cast<double>(bytes);
+        state.counters[name + "/word"] = static_cast<double>(values[i]) / static_cast<double>(words);
+    }
+    if (counters.available(PerfCounters::CYCLES) && counters.available(PerfCounters::INSTRUCTIONS)) {
+        state.counters["IPC"] = static_cast<double>(values[PerfCounters::INSTRUCTIONS])
+            / static_cast<double>(values[PerfCounters::CYCLES]);
+    }
+}
+#endif
+
 template<typename F>
 static void run(benchmark::State &state, F f, const std::string &test_dir) {
+#ifdef ENABLE_PERF_COUNTERS
+    PerfCounters counters;
+    PerfCounters::Values total{};
+    size_t bytes = 0;
+    size_t words = 0;
+#endif
     for (auto _ : state) {
         auto file = std::string(files[state.range(0)]);
         state.SetLabel(file);
+#ifdef ENABLE_PERF_COUNTERS
+        counters.start();
+#endif
         const auto &data = f(test_dir + file);
+#ifdef ENABLE_PERF_COUNTERS
+        const auto values = counters.stop();
+
+        state.PauseTiming();
+        for (size_t i = 0; i < PerfCounters::EVENTS_COUNT; ++i) {
+            total[i] += values[i];
+        }
+        bytes += std::filesystem::file_size(test_dir + file);
+        for (const auto &[word, count] : data) {
+            words += count;
+        }
+        state.ResumeTiming();
+#endif
+    }
+#ifdef ENABLE_PERF_COUNTERS
+    if (!counters.available()) {
+        state.SetLabel(std::string(files[state.range(0)]) + " (perf counters are not permitted)");
+    } else if (bytes > 0 && words > 0) {
+        report_perf_counters(state, counters, total, bytes, words);
     }
+#endif
 }
 
 template <class ...Args>
@@ -46,6 +99,8 @@ static void BM_BaseCountFreq(benchmark::State &state, Args&&... args) {
 }
 
 BASE_FREQ_BENCHMARK(BM_BaseCountFreq, process_file_blocking_read, dict_words);
+BASE_FREQ_BENCHMARK(BM_BaseCountFreq, process_file_pipelined, dict_words);
+BASE_FREQ_BENCHMARK(BM_BaseCountFreq, process_file_direct, dict_words);
 #ifdef ENABLE_PROCESS_MMAPED_FILE
 BASE_FREQ_BENCHMARK(BM_BaseCountFreq, process_mmaped_file, dict_words);
 #endif
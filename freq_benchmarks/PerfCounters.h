@@ -0,0 +1,152 @@
+#ifndef FREQ_BENCHMARKS_PERF_COUNTERS_H
+#define FREQ_BENCHMARKS_PERF_COUNTERS_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters opened directly with perf_event_open.
+// Counters are inherited by threads spawned after start(),
+// so thread pool workers of the measured engine are included.
+// Events which cannot be opened (no PMU in VM, perf_event_paranoid, ...)
+// are silently skipped, available() tells whether anything is counted.
+class PerfCounters {
+ public:
+  enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    DTLB_MISSES,
+    EVENTS_COUNT
+  };
+
+  static constexpr std::array<std::string_view, EVENTS_COUNT> names{
+      "cycles",
+      "instructions",
+      "llc-misses",
+      "branch-misses",
+      "dtlb-misses",
+  };
+
+  using Values = std::array<uint64_t, EVENTS_COUNT>;
+
+  PerfCounters() {
+      fds.fill(-1);
+#ifdef __linux__
+      constexpr uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB
+          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+      open_event(CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+      open_event(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+      open_event(LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      open_event(BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+      open_event(DTLB_MISSES, PERF_TYPE_HW_CACHE, dtlb_read_miss);
+#endif
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  ~PerfCounters() {
+#ifdef __linux__
+      for (int fd : fds) {
+          if (fd >= 0) {
+              close(fd);
+          }
+      }
+#endif
+  }
+
+  [[nodiscard]] bool available() const {
+      return std::any_of(fds.begin(), fds.end(), [](int fd) { return fd >= 0; });
+  }
+
+  [[nodiscard]] bool available(Event event) const {
+      return fds[event] >= 0;
+  }
+
+  // Reads the counters instead of resetting them: PERF_EVENT_IOC_RESET
+  // does not clear counts which exited inherited threads folded back into
+  // the event, so workers of earlier runs would be counted again.
+  void start() {
+#ifdef __linux__
+      for (size_t i = 0; i < EVENTS_COUNT; ++i) {
+          if (fds[i] >= 0) {
+              started[i] = read_event(fds[i]);
+              ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+          }
+      }
+#endif
+  }
+
+  // Returns counted values since start(), scaled
+  // in case the kernel had to multiplex counters.
+  Values stop() {
+      Values values{};
+#ifdef __linux__
+      for (size_t i = 0; i < EVENTS_COUNT; ++i) {
+          if (fds[i] < 0) {
+              continue;
+          }
+          ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+          const Reading stopped = read_event(fds[i]);
+          if (stopped.time_running <= started[i].time_running) {
+              continue;
+          }
+          const uint64_t running = stopped.time_running - started[i].time_running;
+          values[i] = static_cast<uint64_t>(
+              static_cast<double>(stopped.value - started[i].value)
+                  * static_cast<double>(stopped.time_enabled - started[i].time_enabled) / running
+          );
+      }
+#endif
+      return values;
+  }
+
+ private:
+  struct Reading {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+  };
+
+#ifdef __linux__
+  static Reading read_event(int fd) {
+      Reading reading{};
+      if (::read(fd, &reading, sizeof(reading)) != sizeof(reading)) {
+          return {};
+      }
+      return reading;
+  }
+
+  void open_event(Event event, uint32_t type, uint64_t config) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      fds[event] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+
+  std::array<int, EVENTS_COUNT> fds{};
+  std::array<Reading, EVENTS_COUNT> started{};
+};
+
+#endif //FREQ_BENCHMARKS_PERF_COUNTERS_H
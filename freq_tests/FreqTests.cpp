@@ -1,8 +1,36 @@
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+
 #include "gtest/gtest.h"
 
+#include "../libs/ring_queue.h"
+#include "../src/chunk_edge.h"
+#include "../src/counter.h"
+#include "../src/engines.h"
+#include "../src/fields.h"
 #include "../src/freq.h"
+#include "../src/freq_c.h"
+#include "../src/shard.h"
+#include "../src/token_filter.h"
+#include "../src/window.h"
 #include "../src/dummy/freq_dummy.h"
 
+static std::map<std::string, size_t> to_map(const FreqMap &freq) {
+    return {freq.begin(), freq.end()};
+}
+
+static std::map<std::string, size_t> to_map(const WordTree &tree) {
+    std::map<std::string, size_t> result;
+    tree.for_each([&](std::string_view word, size_t count) {
+      result.emplace(word, count);
+    });
+    return result;
+}
+
 template <typename F>
 void base_test(F f, const std::string &test_dir) {
     for (const std::string &test : {
@@ -15,8 +43,8 @@ void base_test(F f, const std::string &test_dir) {
         const std::string filename(test_dir + test);
         auto x = f(filename);
         auto y = process_file_dummy(filename);
-        auto actual = std::map(x.begin(), x.end());
-        auto expected = std::map(y.begin(), y.end());
+        auto actual = to_map(x);
+        auto expected = to_map(y);
         decltype(actual) actual_minus_expected;
         decltype(actual) expected_minus_actual;
 
@@ -58,6 +86,791 @@ TEST(freq_test, l40k_offset_test) {
     base_test(process_file_blocking_read, "../test_cases/40k_offset/");
 }
 
+TEST(freq_test, dict_words_unbatched_test) {
+    auto &config = FreqConfig::instance();
+    const size_t batch_size = config.get_insert_batch_size();
+    config.set_insert_batch_size(0);
+    base_test(process_file_blocking_read, "../test_cases/dict_words/");
+    config.set_insert_batch_size(batch_size);
+}
+
+TEST(freq_test, pipelined_test) {
+    auto &config = FreqConfig::instance();
+    const size_t block_size = config.get_read_block_size();
+    const size_t read_ahead = config.get_read_ahead();
+    // Small blocks put many words and single words across block boundaries.
+    config.set_read_block_size(4099);
+    config.set_read_ahead(4);
+    base_test(process_file_pipelined, "../test_cases/dict_words/");
+    base_test(process_file_pipelined, "../test_cases/single_word/");
+    config.set_read_block_size(block_size);
+    config.set_read_ahead(read_ahead);
+}
+
+TEST(freq_test, direct_test) {
+    auto &config = FreqConfig::instance();
+    const size_t block_size = config.get_read_block_size();
+    // Not a multiple of the alignment, rounded up by the reader.
+    config.set_read_block_size(100000);
+    base_test(process_file_direct, "../test_cases/dict_words/");
+    base_test(process_file_direct, "../test_cases/unique_words/");
+    config.set_read_block_size(block_size);
+}
+
+#ifdef HAS_LIBAIO
+TEST(freq_test, aio_test) {
+    auto &config = FreqConfig::instance();
+    const size_t block_size = config.get_read_block_size();
+    config.set_read_block_size(100000);
+    base_test(process_file_aio, "../test_cases/dict_words/");
+    base_test(process_file_aio, "../test_cases/single_word/");
+    config.set_read_block_size(block_size);
+}
+#endif
+
+TEST(freq_test, engines_test) {
+    const std::string filename("../test_cases/dict_words/test-100000.txt");
+    // Cut in the middle of a word.
+    const size_t limit = 300007;
+    std::ifstream input(filename, std::ifstream::binary);
+    std::string prefix(limit, '\0');
+    input.read(prefix.data(), static_cast<std::streamsize>(limit));
+    const auto prefix_file = (std::filesystem::temp_directory_path() / "freq_engines_test.txt").string();
+    std::ofstream(prefix_file, std::ofstream::binary) << prefix;
+    const auto expected = to_map(process_file_dummy(prefix_file));
+
+    auto &config = FreqConfig::instance();
+    const size_t block_size = config.get_read_block_size();
+    config.set_read_block_size(65536);
+    config.set_input_limit(limit);
+    for (const auto &engine : engines()) {
+        EXPECT_EQ(find_engine(engine.name), &engine);
+        if (engine.parallel) {
+            EXPECT_EQ(to_map(engine.process(filename)), expected) << engine.name;
+        }
+    }
+    config.set_input_limit(std::numeric_limits<size_t>::max());
+    config.set_read_block_size(block_size);
+
+    EXPECT_EQ(find_engine("unknown"), nullptr);
+    EXPECT_EQ(choose_engine(prefix_file).engine, find_engine("dummy"));
+    std::filesystem::remove(prefix_file);
+
+    // Only small inputs go through iostreams, on any number of cores.
+    const size_t threads = config.get_processor_count();
+    config.set_processor_count(1);
+    const auto choice = choose_engine("../test_cases/dict_words/test-1000000.txt");
+    EXPECT_TRUE(choice.engine->parallel) << choice.engine->name;
+    config.set_processor_count(threads);
+}
+
+TEST(freq_test, spill_test) {
+    for (const std::string filename : {
+        "../test_cases/unique_words/test-1000000.txt",
+        "../test_cases/dict_words/test-1000000.txt",
+    }) {
+        std::vector<std::pair<std::string, size_t>> expected;
+        for (auto &&entry : process_file_dummy(filename)) {
+            expected.push_back(std::move(entry));
+        }
+        std::sort(expected.begin(), expected.end());
+
+        for (const bool alphabetical : {true, false}) {
+            // Small enough to spill many times, and unlimited.
+            for (const size_t budget : {size_t{4} << 20, std::numeric_limits<size_t>::max() / 2}) {
+                std::vector<std::pair<std::string, size_t>> actual;
+                count_with_spill(filename, budget, alphabetical, [&](std::string_view word, size_t count) {
+                  actual.emplace_back(word, count);
+                });
+                if (!alphabetical) {
+                    EXPECT_TRUE(std::is_sorted(actual.begin(), actual.end(), [](const auto &lhs, const auto &rhs) {
+                      return std::tie(rhs.second, lhs.first) < std::tie(lhs.second, rhs.first);
+                    }));
+                    std::sort(actual.begin(), actual.end());
+                }
+                EXPECT_EQ(actual, expected) << filename << ' ' << budget;
+            }
+        }
+    }
+
+    // Thousands of distinct words a partition, which are counted again in one table
+    // and have to be spread over all of its home slots.
+    const auto filename = (std::filesystem::temp_directory_path() / "freq-spill-test.txt").string();
+    std::mt19937 rng(7);
+    std::map<std::string, size_t> expected;
+    std::set<uint64_t> home_slots;
+    {
+        std::ofstream file(filename, std::ofstream::binary);
+        for (size_t i = 0; i < 600000; ++i) {
+            std::string word(9, 'a');
+            for (auto &c : word) {
+                c = static_cast<char>('a' + rng() % 26);
+            }
+            file << word << (i % 16 ? ' ' : '\n');
+            ++expected[word];
+            const uint64_t hash = WordMap::hash(word);
+            if (Spill::partition(hash) == 0) {
+                home_slots.insert(hash >> 56);
+            }
+        }
+    }
+    EXPECT_GT(expected.size() / Spill::partition_count, 2000);
+    EXPECT_GT(home_slots.size(), 200);
+
+    std::map<std::string, size_t> actual;
+    count_with_spill(filename, size_t{4} << 20, true, [&](std::string_view word, size_t count) {
+      actual.emplace(word, count);
+    });
+    EXPECT_EQ(actual, expected);
+    std::filesystem::remove(filename);
+}
+
+TEST(freq_test, shard_test) {
+    const auto directory = std::filesystem::temp_directory_path() / "freq-shard-test";
+    std::filesystem::create_directories(directory);
+    for (const std::string filename : {
+        "../test_cases/dict_words/test-100000.txt",
+        "../test_cases/single_word/test-1000.txt",
+    }) {
+        const auto expected = to_map(process_file_dummy(filename));
+        // More shards than bytes leaves some of them empty.
+        for (const size_t count : {1, 3, 16, 1500}) {
+            std::vector<std::string> paths;
+            for (size_t i = 0; i < count; ++i) {
+                paths.push_back((directory / std::to_string(i)).string());
+                write_partial(filename, i, count, paths.back());
+            }
+            // Partials are merged in any order.
+            std::reverse(paths.begin(), paths.end());
+            EXPECT_EQ(to_map(merge_partials(paths)), expected) << filename << ' ' << count;
+
+            if (count > 1) {
+                paths.pop_back();
+                EXPECT_THROW(merge_partials(paths), std::runtime_error);
+            }
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+TEST(freq_test, document_frequency_test) {
+    const auto directory = std::filesystem::temp_directory_path() / "freq-df-test";
+    std::filesystem::create_directories(directory);
+    auto &config = FreqConfig::instance();
+    const size_t threads = config.get_processor_count();
+    config.set_processor_count(4);
+
+    std::mt19937 rng(7);
+    std::vector<std::string> filenames;
+    std::map<std::string, std::pair<size_t, size_t>> by_line, by_file;
+    for (size_t file_index = 0; file_index < 3; ++file_index) {
+        filenames.push_back((directory / std::to_string(file_index)).string());
+        std::ofstream file(filenames.back(), std::ofstream::binary);
+        std::set<std::string> file_words;
+        // Some lines are longer than a chunk, the last one has no newline.
+        for (size_t line = 0; line < 2000; ++line) {
+            std::set<std::string> line_words;
+            const size_t words = rng() % 500 == 0 ? 20000 : rng() % 20;
+            for (size_t i = 0; i < words; ++i) {
+                std::string word(rng() % 3 + 1, 'a');
+                for (auto &c : word) {
+                    c = static_cast<char>((rng() % 2 ? 'a' : 'A') + rng() % 4);
+                }
+                file << word << (rng() % 4 ? " " : ", ");
+                std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+                ++by_line[word].first;
+                ++by_file[word].first;
+                line_words.insert(word);
+                file_words.insert(word);
+            }
+            for (const auto &word : line_words) {
+                ++by_line[word].second;
+            }
+            if (line + 1 < 2000) {
+                file << '\n';
+            }
+        }
+        for (const auto &word : file_words) {
+            ++by_file[word].second;
+        }
+    }
+
+    const auto to_document_map = [](const DocumentMap &documents) {
+      std::map<std::string, std::pair<size_t, size_t>> result;
+      for (const auto &[word, entry] : documents) {
+          result[word] = {entry.count, entry.documents};
+      }
+      return result;
+    };
+    EXPECT_EQ(to_document_map(process_files_documents(filenames, true)), by_line);
+    EXPECT_EQ(to_document_map(process_files_documents(filenames, false)), by_file);
+
+    config.set_processor_count(threads);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(freq_test, token_filter_test) {
+    const std::string filename("../test_cases/dict_words/test-100000.txt");
+    const TokenFilter filter(2, 7, Vocabulary({"the", "of", "a", "and", "in"}));
+    EXPECT_FALSE(filter.accepts("the"));
+    EXPECT_FALSE(filter.accepts("x"));
+    EXPECT_FALSE(filter.accepts("abcdefgh"));
+    EXPECT_TRUE(filter.accepts("then"));
+    EXPECT_TRUE(filter.accepts("to"));
+
+    auto expected = to_map(process_file_dummy(filename));
+    std::erase_if(expected, [&](const auto &entry) { return !filter.accepts(entry.first); });
+
+    auto &config = FreqConfig::instance();
+    const size_t block_size = config.get_read_block_size();
+    config.set_read_block_size(65536);
+    config.set_token_filter(&filter);
+    for (const auto &engine : engines()) {
+        EXPECT_EQ(to_map(engine.process(filename)), expected) << engine.name;
+    }
+    EXPECT_EQ(to_map(process_file_blocking_read_tree(filename)), expected);
+
+    std::ifstream file(filename, std::ifstream::binary);
+    const std::string text(std::istreambuf_iterator<char>(file), {});
+    FreqCounter counter;
+    for (size_t offset = 0; offset < text.size(); offset += 1000) {
+        counter.feed(std::string_view(text).substr(offset, 1000));
+    }
+    counter.finish();
+    EXPECT_EQ(to_map(counter.take()), expected);
+    config.set_token_filter(nullptr);
+    config.set_read_block_size(block_size);
+}
+
+TEST(freq_test, sample_test) {
+    const std::string filename("../test_cases/dict_words/test-1000000.txt");
+    const auto expected = to_map(process_file_dummy(filename));
+
+    // Sampling every block counts every word once, whichever block boundaries it crosses.
+    const auto all = process_file_sampled(filename, 1, 0);
+    EXPECT_GT(all.blocks, 100);
+    EXPECT_EQ(all.sampled, all.blocks);
+    std::map<std::string, size_t> counted;
+    all.words.for_each([&](std::string_view word, const SampleCount &entry, uint64_t) {
+      const auto estimate = all.estimate(entry);
+      EXPECT_EQ(estimate.count, entry.count);
+      EXPECT_EQ(estimate.low, entry.count);
+      EXPECT_EQ(estimate.high, entry.count);
+      counted.emplace(word, entry.count);
+    });
+    EXPECT_EQ(counted, expected);
+
+    const auto sample = process_file_sampled(filename, 0.1, 42);
+    EXPECT_EQ(sample.sampled, (sample.blocks + 5) / 10);
+    size_t frequent = 0;
+    size_t covered = 0;
+    sample.words.for_each([&](std::string_view word, const SampleCount &entry, uint64_t) {
+      const size_t count = expected.at(std::string(word));
+      const auto estimate = sample.estimate(entry);
+      EXPECT_LE(estimate.low, estimate.count);
+      EXPECT_LE(estimate.count, estimate.high);
+      EXPECT_LE(entry.count, count);
+      if (count >= 100) {
+          ++frequent;
+          covered += estimate.low <= count && count <= estimate.high;
+      }
+    });
+    EXPECT_GT(frequent, 10);
+    EXPECT_GE(covered * 10, frequent * 8);
+}
+
+TEST(freq_test, window_test) {
+    int64_t seconds = 0;
+    EXPECT_EQ(parse_timestamp("1700000000 up", seconds), 10);
+    EXPECT_EQ(seconds, 1700000000);
+    EXPECT_EQ(parse_timestamp("[1700000000.250] up", seconds), 15);
+    EXPECT_EQ(parse_timestamp("2023-11-14T22:13:20Z up", seconds), 20);
+    EXPECT_EQ(seconds, 1700000000);
+    EXPECT_EQ(parse_timestamp("2023-11-15 00:13:20.5+02:00 up", seconds), 27);
+    EXPECT_EQ(seconds, 1700000000);
+    EXPECT_EQ(parse_timestamp("2023-13-01T00:00:00 up", seconds), 0);
+    EXPECT_EQ(parse_timestamp("42 up", seconds), 0);
+    EXPECT_EQ(format_timestamp(1700000000), "2023-11-14T22:13:20Z");
+
+    // Lines without a timestamp belong to the bucket of the line before.
+    const int64_t window = 60, step = 10;
+    const size_t top = 3;
+    const std::vector<std::string> vocabulary = {"alpha", "beta", "gamma", "delta", "epsilon", "zeta"};
+    std::mt19937 random(7);
+    std::string log;
+    std::vector<std::pair<int64_t, std::string>> lines;
+    int64_t time = 1700000000;
+    for (int i = 0; i < 2000; ++i) {
+        time += random() % 8 == 0 ? random() % 200 : random() % 3;
+        std::string words;
+        for (size_t j = random() % 4; j > 0; --j) {
+            words += ' ' + vocabulary[random() % vocabulary.size()];
+        }
+        log += (random() % 2 ? std::to_string(time) : format_timestamp(time)) + words + '\n';
+        lines.emplace_back(time / step, words);
+        if (random() % 5 == 0) {
+            log += " beta Beta\n";
+            lines.emplace_back(time / step, " beta Beta");
+        }
+    }
+
+    std::vector<std::pair<int64_t, std::vector<std::pair<std::string, size_t>>>> windows;
+    WindowCounter counter(window, step, top, [&](int64_t end, const auto &words) {
+      windows.emplace_back(end, words);
+    });
+    for (size_t pos = 0; pos < log.size();) {
+        const size_t size = std::min<size_t>(random() % 300, log.size() - pos);
+        counter.feed(std::span(log.data() + pos, size));
+        pos += size;
+    }
+    counter.finish();
+
+    std::vector<std::pair<int64_t, std::vector<std::pair<std::string, size_t>>>> expected;
+    for (int64_t bucket = lines.front().first; bucket <= lines.back().first; ++bucket) {
+        std::map<std::string, size_t> counts;
+        for (const auto &[line_bucket, words] : lines) {
+            if (line_bucket <= bucket && line_bucket > bucket - window / step) {
+                std::istringstream stream(words);
+                for (std::string word; stream >> word;) {
+                    std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+                    ++counts[word];
+                }
+            }
+        }
+        if (counts.empty()) {
+            continue;
+        }
+        std::vector<std::pair<std::string, size_t>> ranked(counts.begin(), counts.end());
+        std::stable_sort(ranked.begin(), ranked.end(), [](const auto &lhs, const auto &rhs) {
+          return lhs.second > rhs.second;
+        });
+        ranked.resize(std::min(ranked.size(), top));
+        expected.emplace_back((bucket + 1) * step, ranked);
+    }
+    EXPECT_EQ(windows, expected);
+}
+
+TEST(freq_test, fields_test) {
+    const auto filename = (std::filesystem::temp_directory_path() / "freq-fields-test.csv").string();
+    auto &config = FreqConfig::instance();
+    const size_t threads = config.get_processor_count();
+    const size_t block_size = config.get_read_block_size();
+    config.set_processor_count(4);
+    config.set_read_block_size(size_t{1} << 16);
+
+    // Fields 2 and 4 of 6, some quoted with separators, newlines and quotes inside.
+    const std::vector<size_t> fields = {4, 2};
+    std::mt19937 rng(7);
+    std::string csv;
+    FreqCounter expected;
+    for (size_t record = 0; csv.size() < (size_t{3} << 20); ++record) {
+        for (size_t field = 1; field <= 6; ++field) {
+            std::string text;
+            for (size_t i = rng() % 6; i > 0; --i) {
+                text += "Word" + std::string(1, static_cast<char>('a' + rng() % 26)) + (rng() % 2 ? " " : "-");
+            }
+            const bool selected = field == 2 || field == 4;
+            if (rng() % 3 == 0) {
+                text += rng() % 2 ? ",x\n" : "\"y";
+                std::string quoted = "\"";
+                for (const char c : text) {
+                    quoted += c == '"' ? "\"\"" : std::string(1, c);
+                }
+                csv += quoted + '"';
+            } else {
+                csv += text;
+            }
+            if (selected) {
+                expected.feed(text);
+                expected.finish();
+            }
+            csv += field < 6 ? ',' : '\n';
+        }
+    }
+    std::ofstream(filename, std::ofstream::binary) << csv;
+
+    // Records, fields and quotes are split between pieces.
+    FieldScanner scanner(fields, ',');
+    std::string selected;
+    for (size_t pos = 0; pos < csv.size();) {
+        const size_t size = std::min<size_t>(rng() % 40, csv.size() - pos);
+        scanner.scan(std::span(csv.data() + pos, size), selected);
+        pos += size;
+    }
+    FreqCounter scanned;
+    scanned.feed(selected);
+    scanned.finish();
+    EXPECT_EQ(to_map(scanned.words()), to_map(expected.words()));
+
+    EXPECT_EQ(to_map(process_file_fields(filename, fields, ',')), to_map(expected.words()));
+
+    config.set_processor_count(threads);
+    config.set_read_block_size(block_size);
+    std::filesystem::remove(filename);
+}
+
+TEST(freq_test, counter_test) {
+    const std::string filename = "../test_cases/dict_words/test-100000.txt";
+    std::ifstream file(filename, std::ifstream::binary);
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const auto expected = process_file_dummy(filename);
+
+    // Pieces of random sizes, most of them cutting words.
+    std::mt19937 rng(42);
+    FreqCounter counter;
+    for (size_t offset = 0; offset < text.size();) {
+        const size_t size = std::min<size_t>(rng() % 20, text.size() - offset);
+        counter.feed(std::span(text.data() + offset, size));
+        offset += size;
+    }
+    counter.finish();
+    EXPECT_EQ(to_map(counter.words()), to_map(expected));
+
+    std::vector<std::pair<std::string, size_t>> top;
+    for (auto &&entry : expected) {
+        top.push_back(std::move(entry));
+    }
+    std::sort(top.begin(), top.end(), [](const auto &lhs, const auto &rhs) {
+      return std::tie(rhs.second, lhs.first) < std::tie(lhs.second, rhs.first);
+    });
+    top.resize(10);
+    EXPECT_EQ(counter.top(10), top);
+
+    // Documents end words, so every line counted as a document gives the same words.
+    std::vector<std::string_view> documents;
+    for (size_t begin = 0, end; begin < text.size(); begin = end + 1) {
+        end = std::min(text.find('\n', begin), text.size());
+        documents.emplace_back(text.data() + begin, end - begin);
+    }
+    FreqCounter batch;
+    batch.feed_documents(documents);
+    EXPECT_EQ(to_map(batch.words()), to_map(counter.words()));
+
+    FreqCounter fragments;
+    fragments.feed_documents(std::vector<std::string_view>{"ab", "c", "ab c"});
+    EXPECT_EQ(to_map(fragments.words()), (std::map<std::string, size_t>{{"ab", 2}, {"c", 2}}));
+
+    // A counter whose words were taken counts a new text.
+    EXPECT_EQ(to_map(fragments.take()), (std::map<std::string, size_t>{{"ab", 2}, {"c", 2}}));
+    EXPECT_EQ(fragments.words().size(), 0);
+    const std::string_view text_after = "new words new";
+    fragments.feed(std::span(text_after.data(), text_after.size()));
+    fragments.finish();
+    EXPECT_EQ(to_map(fragments.words()), (std::map<std::string, size_t>{{"new", 2}, {"words", 1}}));
+}
+
+TEST(freq_test, c_interface_test) {
+    freq_counter *counter = freq_counter_new();
+    ASSERT_NE(counter, nullptr);
+    EXPECT_EQ(freq_counter_feed(counter, "The cat and the do", 18), 0);
+    EXPECT_EQ(freq_counter_feed(counter, "g THE", 5), 0);
+    EXPECT_EQ(freq_counter_finish(counter), 0);
+    const char *documents[] = {"dog", "cat dog"};
+    const size_t sizes[] = {3, 7};
+    EXPECT_EQ(freq_counter_feed_documents(counter, documents, sizes, 2), 0);
+    EXPECT_EQ(freq_counter_size(counter), 4);
+
+    freq_entry entries[3];
+    ASSERT_EQ(freq_counter_top(counter, 3, entries), 3);
+    EXPECT_EQ(std::string_view(entries[0].word, entries[0].size), "dog");
+    EXPECT_EQ(entries[0].count, 3);
+    EXPECT_EQ(std::string_view(entries[1].word, entries[1].size), "the");
+    EXPECT_EQ(entries[1].count, 3);
+    EXPECT_EQ(std::string_view(entries[2].word, entries[2].size), "cat");
+    EXPECT_EQ(entries[2].count, 2);
+    freq_counter_free(counter);
+}
+
+TEST(freq_test, dict_words_tree_test) {
+    base_test(process_file_blocking_read_tree, "../test_cases/dict_words/");
+}
+
+TEST(freq_test, l40k_offset_tree_test) {
+    base_test(process_file_blocking_read_tree, "../test_cases/40k_offset/");
+}
+
+TEST(freq_test, word_tree_test) {
+    std::mt19937 rng(42);
+    std::map<std::string, size_t> expected;
+    WordTree first, second;
+
+    for (size_t i = 0; i < 200000; ++i) {
+        // Small alphabet for shared prefixes, full one for wide nodes.
+        std::string word(rng() % 12 + 1, 'a');
+        for (auto &c : word) {
+            c = static_cast<char>('a' + rng() % (i % 4 ? 3 : 26));
+        }
+        ++expected[word];
+        ++(i % 2 ? first : second)[word];
+    }
+    first.merge(std::move(second));
+
+    EXPECT_EQ(first.size(), expected.size());
+    EXPECT_EQ(second.size(), 0);
+    EXPECT_EQ(to_map(first), expected);
+    EXPECT_EQ(first.get("abc"), expected["abc"]);
+    EXPECT_EQ(first.get("abcd0"), 0);
+
+    std::vector<std::string> words;
+    first.for_each([&](std::string_view word, size_t) {
+      words.emplace_back(word);
+    }, "ab");
+    std::vector<std::string> expected_words;
+    WordTree::PrefixCount expected_count;
+    for (const auto &[word, count] : expected) {
+        if (word.starts_with("ab")) {
+            expected_words.push_back(word);
+            ++expected_count.words;
+            expected_count.total += count;
+        }
+    }
+    EXPECT_EQ(words, expected_words);
+    EXPECT_EQ(first.prefix_count("ab").words, expected_count.words);
+    EXPECT_EQ(first.prefix_count("ab").total, expected_count.total);
+}
+
+TEST(freq_test, vocabulary_test) {
+    const std::string filename("../test_cases/dict_words/test-100000.txt");
+    const auto all = to_map(process_file_dummy(filename));
+
+    std::vector<std::string> words{"notaword", "zzzzzzz"};
+    std::map<std::string, size_t> expected;
+    bool take = true;
+    for (const auto &[word, count] : all) {
+        if (take) {
+            words.push_back(word);
+            expected.emplace(word, count);
+        }
+        take = !take;
+    }
+
+    const Vocabulary vocabulary(words);
+    EXPECT_EQ(vocabulary.size(), words.size());
+    for (size_t i = 0; i < vocabulary.size(); ++i) {
+        EXPECT_EQ(vocabulary.find(vocabulary.word(i)), i);
+    }
+    EXPECT_EQ(vocabulary.find("not in vocabulary"), Vocabulary::npos);
+
+    EXPECT_EQ(to_map(process_file_blocking_read_vocab(filename, vocabulary)), expected);
+}
+
+TEST(freq_test, word_map_test) {
+    std::mt19937 rng(42);
+    std::map<std::string, size_t> expected;
+    WordMap first, second;
+
+    for (size_t i = 0; i < 200000; ++i) {
+        std::string word(rng() % 64 + 1, 'a');
+        for (auto &c : word) {
+            c = static_cast<char>('a' + rng() % 3);
+        }
+        ++expected[word];
+        ++(i % 2 ? first : second)[word];
+    }
+    first.merge(second);
+
+    EXPECT_EQ(first.size(), expected.size());
+    EXPECT_EQ(std::map(first.begin(), first.end()), expected);
+    for (const auto &[word, count] : expected) {
+        EXPECT_EQ(first.get(word), count);
+    }
+    EXPECT_EQ(first.get("d"), 0);
+
+    WordMap rehashed;
+    first.for_each([&](std::string_view word, size_t count, uint64_t hash) {
+      EXPECT_EQ(hash, WordMap::hash(word));
+      rehashed.find_or_insert(word, hash) += count;
+    });
+    EXPECT_EQ(std::map(rehashed.begin(), rehashed.end()), expected);
+
+    rehashed.retain([](std::string_view word, size_t count) { return count > 2 && word.size() != 20; });
+    std::erase_if(expected, [](const auto &entry) { return entry.second <= 2 || entry.first.size() == 20; });
+    EXPECT_EQ(std::map(rehashed.begin(), rehashed.end()), expected);
+    for (const auto &[word, count] : expected) {
+        EXPECT_EQ(rehashed.get(word), count);
+    }
+
+    // Moved from maps are empty and take words again.
+    WordMap moved(std::move(rehashed));
+    EXPECT_EQ(std::map(moved.begin(), moved.end()), expected);
+    EXPECT_EQ(rehashed.size(), 0);
+    EXPECT_EQ(rehashed.memory_usage(), 0);
+    const std::string long_word(40, 'x');
+    for (const std::string_view word : {"a", "abcdefghijklmnopqrstu", long_word.c_str()}) {
+        ++rehashed[word];
+    }
+    EXPECT_EQ(rehashed.size(), 3);
+    EXPECT_EQ(rehashed.get(long_word), 1);
+    moved = std::move(rehashed);
+    EXPECT_EQ(moved.size(), 3);
+    EXPECT_EQ(rehashed.size(), 0);
+    ++rehashed["a"];
+    EXPECT_EQ(std::map(rehashed.begin(), rehashed.end()), (std::map<std::string, size_t>{{"a", 1}}));
+}
+
+TEST(freq_test, lossy_test) {
+    const auto filename = (std::filesystem::temp_directory_path() / "freq_lossy_test.txt").string();
+    std::mt19937 rng(11);
+    size_t words = 0;
+    {
+        // Long tail: a few frequent words and many rare ones.
+        std::ofstream file(filename, std::ofstream::binary);
+        for (; words < 2000000; ++words) {
+            const size_t rank = rng() % 2 ? rng() % 100 : rng() % 1000000;
+            std::string word;
+            for (size_t i = rank + 1; i > 0; i /= 26) {
+                word += static_cast<char>('a' + i % 26);
+            }
+            file << word << ' ';
+        }
+    }
+    const auto exact = to_map(process_file_dummy(filename));
+
+    auto &config = FreqConfig::instance();
+    const size_t threads = config.get_processor_count();
+    const size_t block_size = config.get_read_block_size();
+    const double error = 0.0005;
+    config.set_processor_count(2);
+    config.set_read_block_size(1 << 20);
+    config.set_lossy_error(error);
+    const auto lossy = to_map(process_file_lossy(filename));
+    const auto [partial, edge] = process_file_range(filename, 0, std::filesystem::file_size(filename));
+    config.set_lossy_error(0);
+    config.set_read_block_size(block_size);
+    config.set_processor_count(threads);
+
+    EXPECT_LT(lossy.size(), exact.size() / 2);
+    EXPECT_LT(partial.size(), exact.size() / 2);
+    for (const auto &[word, count] : exact) {
+        const auto it = lossy.find(word);
+        const size_t estimate = it == lossy.end() ? 0 : it->second;
+        EXPECT_LE(estimate, count) << word;
+        EXPECT_LE(count - estimate, error * words) << word;
+    }
+    std::filesystem::remove(filename);
+}
+
+TEST(freq_test, ring_queue_test) {
+    constexpr uint64_t items = 200000;
+    constexpr uint64_t expected = items * (items + 1) / 2;
+
+    // Small rings, so producers and consumers keep waiting for each other.
+    SpscQueue<uint64_t> spsc(4);
+    uint64_t spsc_sum = 0;
+    std::thread consumer([&] {
+      for (uint64_t i = 1; i <= items; ++i) {
+          const uint64_t value = spsc.pop();
+          EXPECT_EQ(value, i);
+          spsc_sum += value;
+      }
+    });
+    for (uint64_t i = 1; i <= items; ++i) {
+        spsc.push(i);
+    }
+    consumer.join();
+    EXPECT_EQ(spsc_sum, expected);
+
+    constexpr size_t threads = 4;
+    MpmcQueue<uint64_t> mpmc(8);
+    EXPECT_EQ(mpmc.capacity(), 8);
+    std::atomic<uint64_t> mpmc_sum = 0;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          for (uint64_t i = t + 1; i <= items; i += threads) {
+              mpmc.push(i);
+          }
+        });
+        workers.emplace_back([&] {
+          uint64_t sum = 0;
+          for (uint64_t i = 0; i < items / threads; ++i) {
+              sum += mpmc.pop();
+          }
+          mpmc_sum += sum;
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    EXPECT_EQ(mpmc_sum, expected);
+
+    uint64_t value = 0;
+    EXPECT_FALSE(mpmc.try_pop(value));
+    for (uint64_t i = 0; i < mpmc.capacity(); ++i) {
+        EXPECT_TRUE(mpmc.try_push(i));
+    }
+    EXPECT_FALSE(mpmc.try_push(value));
+    EXPECT_TRUE(mpmc.try_pop(value));
+    EXPECT_EQ(value, 0);
+}
+
+static ChunkEdge summarize(std::string_view chunk, std::map<std::string, size_t> &words) {
+    const char *begin = chunk.data();
+    const char *end = begin + chunk.size();
+    const char *first = std::find_if(begin, end, is_delim);
+    if (first == end) {
+        return ChunkEdge::whole(begin, end);
+    }
+    const char *last = std::find_if(std::reverse_iterator(end), std::reverse_iterator(first), is_delim).base();
+    for (auto it = std::find_if_not(first, last, is_delim); it < last;) {
+        auto word_end = std::find_if(it, last, is_delim);
+        ++words[std::string(it, word_end)];
+        it = std::find_if_not(word_end, last, is_delim);
+    }
+    return ChunkEdge::split(begin, first, last, end);
+}
+
+TEST(freq_test, chunk_edge_test) {
+    const std::string text = "ab  cde f\nghij klm  nopqrs t ";
+    for (const std::string_view data : {std::string_view(text), std::string_view(text).substr(2, 17)}) {
+        std::map<std::string, size_t> expected;
+        finish(summarize(data, expected), [&](std::string_view word) { ++expected[std::string(word)]; });
+
+        for (size_t chunk_size = 1; chunk_size <= data.size(); ++chunk_size) {
+            std::map<std::string, size_t> left_fold, tree, appended;
+            const auto count_into = [](auto &words) {
+              return [&words](std::string_view word) { ++words[std::string(word)]; };
+            };
+
+            std::vector<ChunkEdge> edges;
+            for (size_t pos = 0; pos < data.size(); pos += chunk_size) {
+                edges.push_back(summarize(data.substr(pos, chunk_size), left_fold));
+            }
+            tree = left_fold;
+            appended = left_fold;
+
+            // Appending to an owned edge gives the same words as stitching views.
+            OwnedChunkEdge owned;
+            for (const auto &chunk_edge : edges) {
+                owned.append(chunk_edge, count_into(appended));
+            }
+            finish(ChunkEdge{owned.whole_word, owned.left, owned.right}, count_into(appended));
+            EXPECT_EQ(appended, expected) << "chunk size " << chunk_size;
+
+            ChunkEdge edge = edges.front();
+            for (size_t i = 1; i < edges.size(); ++i) {
+                edge = stitch(edge, edges[i], count_into(left_fold));
+            }
+            finish(edge, count_into(left_fold));
+            EXPECT_EQ(left_fold, expected) << "chunk size " << chunk_size;
+
+            // Pairwise reduction gives the same words as the left fold.
+            while (edges.size() > 1) {
+                std::vector<ChunkEdge> next;
+                for (size_t i = 0; i + 1 < edges.size(); i += 2) {
+                    next.push_back(stitch(edges[i], edges[i + 1], count_into(tree)));
+                }
+                if (edges.size() % 2) {
+                    next.push_back(edges.back());
+                }
+                edges.swap(next);
+            }
+            finish(edges.front(), count_into(tree));
+            EXPECT_EQ(tree, expected) << "chunk size " << chunk_size;
+        }
+    }
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,215 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free ring buffers. try_push() and try_pop() never block or
+// take a lock; push() and pop() sleep on a futex (std::atomic::wait) while
+// the queue is full or empty, and a sleeper is woken only when one is
+// registered, so the fast path makes no system call.
+// Capacities are rounded up to a power of two.
+
+namespace ring_queue_detail {
+
+inline constexpr size_t cache_line = 64;
+
+// Sleeping side of a queue: waiters sleep on an epoch which the other
+// side bumps after making progress, if anyone is waiting.
+class Waiters {
+ public:
+  // Waits until ready() or a wake(), ready() is retried once registered,
+  // so a wake() between the two cannot be missed.
+  template<class Ready>
+  bool wait(Ready &&ready) {
+      const uint32_t seen = epoch.load();
+      count.fetch_add(1);
+      if (ready()) {
+          count.fetch_sub(1);
+          return true;
+      }
+      epoch.wait(seen);
+      count.fetch_sub(1);
+      return false;
+  }
+
+  void wake() {
+      // Orders the caller's progress before the check, pairs with count.fetch_add().
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (count.load() > 0) {
+          epoch.fetch_add(1);
+          epoch.notify_all();
+      }
+  }
+
+ private:
+  alignas(cache_line) std::atomic<uint32_t> epoch = 0;
+  std::atomic<uint32_t> count = 0;
+};
+
+}
+
+// One producer thread and one consumer thread. Each side keeps a cached
+// copy of the other's index and reads the shared one only when the cache
+// says the queue is full or empty.
+template<class T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : mask(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1), slots(new T[mask + 1]) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  [[nodiscard]] size_t capacity() const {
+      return mask + 1;
+  }
+
+  bool try_push(T &value) {
+      const size_t position = producer.index.load(std::memory_order_relaxed);
+      if (position - producer.cached >= capacity()) {
+          producer.cached = consumer.index.load(std::memory_order_acquire);
+          if (position - producer.cached >= capacity()) {
+              return false;
+          }
+      }
+      slots[position & mask] = std::move(value);
+      producer.index.store(position + 1, std::memory_order_release);
+      not_empty.wake();
+      return true;
+  }
+
+  bool try_pop(T &value) {
+      const size_t position = consumer.index.load(std::memory_order_relaxed);
+      if (position == consumer.cached) {
+          consumer.cached = producer.index.load(std::memory_order_acquire);
+          if (position == consumer.cached) {
+              return false;
+          }
+      }
+      value = std::move(slots[position & mask]);
+      consumer.index.store(position + 1, std::memory_order_release);
+      not_full.wake();
+      return true;
+  }
+
+  void push(T value) {
+      while (!try_push(value) && !not_full.wait([&] { return try_push(value); })) {}
+  }
+
+  T pop() {
+      T value;
+      while (!try_pop(value) && !not_empty.wait([&] { return try_pop(value); })) {}
+      return value;
+  }
+
+ private:
+  struct alignas(ring_queue_detail::cache_line) Side {
+    std::atomic<size_t> index = 0;
+    // The other side's index as last seen.
+    size_t cached = 0;
+  };
+
+  const size_t mask;
+  std::unique_ptr<T[]> slots;
+  Side producer;
+  Side consumer;
+  ring_queue_detail::Waiters not_empty;
+  ring_queue_detail::Waiters not_full;
+};
+
+// Any number of producers and consumers (D. Vyukov's bounded queue): every
+// slot carries a sequence number telling which lap of the ring may write
+// or read it next, so threads claim slots with one compare-and-swap of
+// an index and never wait for one another to finish.
+template<class T>
+class MpmcQueue {
+ public:
+  explicit MpmcQueue(size_t capacity)
+      : mask(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1), slots(new Slot[mask + 1]) {
+      for (size_t i = 0; i <= mask; ++i) {
+          slots[i].sequence.store(i, std::memory_order_relaxed);
+      }
+  }
+
+  MpmcQueue(const MpmcQueue &) = delete;
+  MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+  [[nodiscard]] size_t capacity() const {
+      return mask + 1;
+  }
+
+  bool try_push(T &value) {
+      size_t position = head.load(std::memory_order_relaxed);
+      for (;;) {
+          Slot &slot = slots[position & mask];
+          const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+          const auto lap = static_cast<std::ptrdiff_t>(sequence - position);
+          if (lap == 0) {
+              if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                  slot.value = std::move(value);
+                  slot.sequence.store(position + 1, std::memory_order_release);
+                  not_empty.wake();
+                  return true;
+              }
+          } else if (lap < 0) {
+              // Not yet read on the previous lap: full.
+              return false;
+          } else {
+              position = head.load(std::memory_order_relaxed);
+          }
+      }
+  }
+
+  bool try_pop(T &value) {
+      size_t position = tail.load(std::memory_order_relaxed);
+      for (;;) {
+          Slot &slot = slots[position & mask];
+          const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+          const auto lap = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+          if (lap == 0) {
+              if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                  value = std::move(slot.value);
+                  slot.sequence.store(position + mask + 1, std::memory_order_release);
+                  not_full.wake();
+                  return true;
+              }
+          } else if (lap < 0) {
+              // Not yet written on this lap: empty.
+              return false;
+          } else {
+              position = tail.load(std::memory_order_relaxed);
+          }
+      }
+  }
+
+  void push(T value) {
+      while (!try_push(value) && !not_full.wait([&] { return try_push(value); })) {}
+  }
+
+  T pop() {
+      T value;
+      while (!try_pop(value) && !not_empty.wait([&] { return try_pop(value); })) {}
+      return value;
+  }
+
+ private:
+  struct alignas(ring_queue_detail::cache_line) Slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  const size_t mask;
+  std::unique_ptr<Slot[]> slots;
+  alignas(ring_queue_detail::cache_line) std::atomic<size_t> head = 0;
+  alignas(ring_queue_detail::cache_line) std::atomic<size_t> tail = 0;
+  ring_queue_detail::Waiters not_empty;
+  ring_queue_detail::Waiters not_full;
+};
+
+#endif
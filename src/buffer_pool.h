@@ -0,0 +1,102 @@
+#ifndef FREQ_SRC_BUFFER_POOL_H
+#define FREQ_SRC_BUFFER_POOL_H
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "../libs/ring_queue.h"
+#include "huge_page_allocator.h"
+#include "pipeline.h"
+
+// Fixed set of equally sized buffers. Coroutines acquiring one wait
+// while all of them are in use, which bounds memory of a read pipeline.
+// Free buffers are recycled through a lock-free ring, the lock is taken
+// only by coroutines which have to wait and by releases which wake them.
+class BufferPool {
+ public:
+  BufferPool(size_t count, size_t buffer_size) : buffers(count), free(count) {
+      for (auto &buffer : buffers) {
+          buffer.resize(buffer_size);
+          free.push(&buffer);
+      }
+  }
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // Awaitable of a free buffer. A coroutine which has to wait is resumed
+  // on executor, in the order of waiting, once a buffer is released.
+  auto acquire(Executor &executor) {
+      struct Awaiter {
+        BufferPool &pool;
+        Executor &executor;
+        Buffer *buffer = nullptr;
+
+        bool await_ready() {
+            return pool.free.try_pop(buffer);
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            std::lock_guard lock(pool.mutex);
+            pool.waiting.fetch_add(1);
+            // Released before the waiter was counted.
+            if (pool.free.try_pop(buffer)) {
+                pool.waiting.fetch_sub(1);
+                return false;
+            }
+            pool.waiters.push_back({h, &executor, &buffer});
+            return true;
+        }
+
+        Buffer &await_resume() {
+            return *buffer;
+        }
+      };
+      return Awaiter{*this, executor};
+  }
+
+  // Hands the buffer to the first waiting coroutine, if any.
+  void release(Buffer &buffer) {
+      // Never full, the ring has room for every buffer.
+      free.push(&buffer);
+      // Pairs with waiting.fetch_add() in acquire(): either the waiter
+      // finds the buffer in the ring, or the release finds the waiter.
+      if (waiting.load() == 0) {
+          return;
+      }
+
+      std::vector<Waiter> woken;
+      {
+          std::lock_guard lock(mutex);
+          Buffer *free_buffer;
+          while (!waiters.empty() && free.try_pop(free_buffer)) {
+              *waiters.front().buffer = free_buffer;
+              woken.push_back(waiters.front());
+              waiters.pop_front();
+              waiting.fetch_sub(1);
+          }
+      }
+      for (const auto &waiter : woken) {
+          waiter.executor->post(waiter.handle);
+      }
+  }
+
+ private:
+  struct Waiter {
+    std::coroutine_handle<> handle;
+    Executor *executor = nullptr;
+    Buffer **buffer = nullptr;
+  };
+
+  std::vector<Buffer> buffers;
+  MpmcQueue<Buffer *> free;
+  std::mutex mutex;
+  std::deque<Waiter> waiters;
+  // Size of waiters, read without the lock.
+  std::atomic<size_t> waiting = 0;
+};
+
+#endif //FREQ_SRC_BUFFER_POOL_H
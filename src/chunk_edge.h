@@ -0,0 +1,149 @@
+#ifndef FREQ_SRC_CHUNK_EDGE_H
+#define FREQ_SRC_CHUNK_EDGE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Words can lie on the boundaries of chunks, so every chunk reports
+// the letters before its first delimiter and after its last one, or
+// that it has no delimiter at all. Summaries of adjacent ranges are
+// combined by an associative stitch(), so they can be reduced in any
+// grouping (in parallel, or incrementally as chunks complete) with
+// O(1) work per chunk and without rescanning the data.
+struct ChunkEdge {
+  // No delimiter in the range, left spans all of it.
+  bool whole_word = true;
+  // Fragments are views into one buffer and keep their position
+  // even when empty, so adjacent fragments can be joined.
+  std::string_view left;
+  std::string_view right;
+
+  static ChunkEdge whole(const char *begin, const char *end) {
+      return {true, std::string_view(begin, end - begin), std::string_view(end, 0)};
+  }
+
+  static ChunkEdge split(const char *begin, const char *first_delim, const char *after_last_delim, const char *end) {
+      return {
+          false,
+          std::string_view(begin, first_delim - begin),
+          std::string_view(after_last_delim, end - after_last_delim)
+      };
+  }
+
+  [[nodiscard]] const char *end() const {
+      return whole_word ? left.data() + left.size() : right.data() + right.size();
+  }
+};
+
+// Copy of a ChunkEdge which outlives the buffer of its chunk.
+struct OwnedChunkEdge {
+  bool whole_word = true;
+  std::string left;
+  std::string right;
+
+  OwnedChunkEdge() = default;
+
+  explicit OwnedChunkEdge(const ChunkEdge &edge)
+      : whole_word(edge.whole_word), left(edge.left), right(edge.right) {}
+
+  // Stitches the edge of the range directly following in place, so a
+  // fragment growing over many ranges is only appended to.
+  // A word completed on their joint is passed to count.
+  template<class F>
+  void append(const ChunkEdge &next, F &&count) {
+      if (next.whole_word) {
+          (whole_word ? left : right).append(next.left);
+          return;
+      }
+      if (whole_word) {
+          left.append(next.left);
+          whole_word = false;
+      } else {
+          right.append(next.left);
+          if (!right.empty()) {
+              count(std::string_view(right));
+          }
+      }
+      right.assign(next.right);
+  }
+};
+
+// Lays fragments of consecutive chunks out in storage, the two fragments
+// of a chunk separated by a delimiter standing for its inner part,
+// and returns edges viewing them, ready to be stitched.
+inline std::vector<ChunkEdge> join_edges(const std::vector<OwnedChunkEdge> &owned, std::string &storage) {
+    size_t total = 0;
+    for (const auto &edge : owned) {
+        total += edge.left.size() + (edge.whole_word ? 0 : 1 + edge.right.size());
+    }
+    storage.clear();
+    storage.reserve(total);
+
+    std::vector<ChunkEdge> edges;
+    edges.reserve(owned.size());
+    for (const auto &edge : owned) {
+        const char *begin = storage.data() + storage.size();
+        storage += edge.left;
+        if (edge.whole_word) {
+            edges.push_back(ChunkEdge::whole(begin, begin + edge.left.size()));
+            continue;
+        }
+        storage += ' ';
+        storage += edge.right;
+        const char *first_delim = begin + edge.left.size();
+        edges.push_back(ChunkEdge::split(begin, first_delim, first_delim + 1, first_delim + 1 + edge.right.size()));
+    }
+    return edges;
+}
+
+// Summary of range a directly followed by range b.
+// A word completed on their joint is passed to count.
+template<class F>
+ChunkEdge stitch(const ChunkEdge &a, const ChunkEdge &b, F &&count) {
+    const auto join = [](std::string_view lhs, std::string_view rhs) {
+      return std::string_view(lhs.data(), rhs.data() + rhs.size() - lhs.data());
+    };
+
+    if (a.whole_word && b.whole_word) {
+        return ChunkEdge::whole(a.left.data(), b.end());
+    }
+    if (a.whole_word) {
+        return {false, join(a.left, b.left), b.right};
+    }
+    if (b.whole_word) {
+        return {false, a.left, join(a.right, b.left)};
+    }
+
+    const auto word = join(a.right, b.left);
+    if (!word.empty()) {
+        count(word);
+    }
+    return {false, a.left, b.right};
+}
+
+// Stitches edges of consecutive ranges in order, returns the edge of all of them.
+template<class F>
+ChunkEdge stitch_all(const std::vector<ChunkEdge> &edges, F &&count) {
+    if (edges.empty()) {
+        return {};
+    }
+    ChunkEdge edge = edges.front();
+    for (auto it = edges.begin() + 1; it != edges.end(); ++it) {
+        edge = stitch(edge, *it, count);
+    }
+    return edge;
+}
+
+// Counts words left on the outer edges of the whole input.
+template<class F>
+void finish(const ChunkEdge &edge, F &&count) {
+    if (!edge.left.empty()) {
+        count(edge.left);
+    }
+    if (!edge.whole_word && !edge.right.empty()) {
+        count(edge.right);
+    }
+}
+
+#endif //FREQ_SRC_CHUNK_EDGE_H
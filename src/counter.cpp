@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <future>
+
+#include "../libs/threadpool.h"
+#include "counter.h"
+#include "freq.h"
+#include "report.h"
+#include "token_filter.h"
+
+void FreqCounter::feed(std::span<const char> data) {
+    const auto count = [this](std::string_view word) {
+      if (is_counted(word)) {
+          ++table[word];
+      }
+    };
+    for_each_piece(data, [&](std::span<const char> piece) {
+      scratch.assign(piece.data(), piece.size());
+      edge.append(count_chunk(std::span(scratch.data(), scratch.size()), table), count);
+    });
+}
+
+void FreqCounter::finish() {
+    ::finish(ChunkEdge{edge.whole_word, edge.left, edge.right}, [this](std::string_view word) {
+      if (is_counted(word)) {
+          ++table[word];
+      }
+    });
+    edge = OwnedChunkEdge();
+}
+
+void FreqCounter::feed_documents(std::span<const std::string_view> documents) {
+    const size_t threads = std::min(FreqConfig::instance().get_processor_count(), documents.size());
+    if (threads <= 1) {
+        FreqCounter counter;
+        for (const auto document : documents) {
+            counter.feed(document);
+            counter.finish();
+        }
+        table.merge(counter.table);
+        return;
+    }
+
+    std::vector<FreqCounter> per_thread(threads);
+    {
+        auto thread_pool = ThreadPool(threads);
+        std::vector<std::future<void>> tasks;
+        // Documents are small, so they are handed out in groups.
+        const size_t group_size = std::max<size_t>(documents.size() / (threads * 4), 1);
+        for (size_t begin = 0; begin < documents.size(); begin += group_size) {
+            const auto group = documents.subspan(begin, std::min(group_size, documents.size() - begin));
+            tasks.push_back(thread_pool.enqueue([&per_thread, group](const size_t thread_index) {
+              auto &counter = per_thread[thread_index];
+              for (const auto document : group) {
+                  counter.feed(document);
+                  counter.finish();
+              }
+            }));
+        }
+        for (auto &task : tasks) {
+            task.get();
+        }
+    }
+    for (const auto &counter : per_thread) {
+        table.merge(counter.table);
+    }
+}
+
+std::vector<std::pair<std::string, size_t>> FreqCounter::top(size_t k) const {
+    std::vector<std::pair<std::string_view, size_t>> entries;
+    entries.reserve(table.size());
+    table.for_each([&](std::string_view word, size_t count, uint64_t) {
+      entries.emplace_back(word, count);
+    });
+
+    const auto middle = entries.begin() + static_cast<std::ptrdiff_t>(std::min(k, entries.size()));
+    std::partial_sort(entries.begin(), middle, entries.end(), report_order(false));
+
+    std::vector<std::pair<std::string, size_t>> result;
+    result.reserve(middle - entries.begin());
+    for (auto it = entries.begin(); it != middle; ++it) {
+        result.emplace_back(it->first, it->second);
+    }
+    return result;
+}
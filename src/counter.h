@@ -0,0 +1,63 @@
+#ifndef FREQ_SRC_COUNTER_H
+#define FREQ_SRC_COUNTER_H
+
+#include <algorithm>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "chunk_edge.h"
+#include "utils.h"
+
+// Streaming counters copy what they are fed and count it this many bytes
+// at a time, so copies stay small whatever the size of a feed() call.
+inline constexpr size_t piece_size = size_t{1} << 20;
+
+// Calls f(piece) for consecutive pieces of data of at most piece_size bytes.
+template<class F>
+void for_each_piece(std::span<const char> data, F &&f) {
+    while (!data.empty()) {
+        const size_t size = std::min(data.size(), piece_size);
+        f(data.first(size));
+        data = data.subspan(size);
+    }
+}
+
+// Counts words of texts kept in memory, fed in pieces of any size:
+// a word may be split between pieces. Not safe to share between threads.
+class FreqCounter {
+ public:
+  // Counts the next piece of the current text.
+  void feed(std::span<const char> data);
+
+  // Ends the current text, counting its last word. Next feed() starts a new text.
+  void finish();
+
+  // Counts every document as a whole text, apart from the current one,
+  // on FreqConfig::get_processor_count() threads.
+  void feed_documents(std::span<const std::string_view> documents);
+
+  // Up to k most frequent words by descending count, equal counts alphabetically.
+  // Words of the current text are included once it is finished.
+  [[nodiscard]] std::vector<std::pair<std::string, size_t>> top(size_t k) const;
+
+  [[nodiscard]] const FreqMap &words() const {
+      return table;
+  }
+
+  FreqMap take() {
+      edge = OwnedChunkEdge();
+      return std::move(table);
+  }
+
+ private:
+  FreqMap table;
+  // Fragments of the current text, words on its ends are not counted yet.
+  OwnedChunkEdge edge;
+  // Pieces are lowercased in this copy.
+  std::string scratch;
+};
+
+#endif //FREQ_SRC_COUNTER_H
@@ -0,0 +1,75 @@
+#ifndef FREQ_SRC_DOCUMENTS_H
+#define FREQ_SRC_DOCUMENTS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include "word_map.h"
+
+// Table entry of a word for document frequencies: occurrences, documents
+// the word occurs in and the id of the last of them. Documents are read
+// one after another, so a repeat within the current one is recognized
+// by the id alone, without a set of words per document.
+struct DocumentCount {
+  size_t count = 0;
+  size_t documents = 0;
+  // 0 before the word is counted in any document.
+  uint64_t last_document = 0;
+
+  void add(uint64_t document) {
+      ++count;
+      if (document != last_document) {
+          ++documents;
+          last_document = document;
+      }
+  }
+
+  // Merged tables count distinct documents, except that the document
+  // both of them counted last may be the same one.
+  DocumentCount &operator+=(const DocumentCount &other) {
+      count += other.count;
+      documents += other.documents;
+      if (other.last_document != 0 && other.last_document == last_document) {
+          --documents;
+      }
+      last_document = std::max(last_document, other.last_document);
+      return *this;
+  }
+};
+
+using DocumentMap = BasicWordMap<HugePageAllocator<char>, DocumentCount>;
+
+// Per-thread counter of words and their documents. Words are counted in
+// one document until begin_document() moves on to the next id, counters
+// of one input have disjoint ids unless they count parts of one document.
+class DocumentCounter {
+ public:
+  explicit DocumentCounter(uint64_t document = 1) : document(document) {}
+
+  void reserve(size_t n) {
+      words.reserve(n);
+  }
+
+  void begin_document() {
+      ++document;
+  }
+
+  void add(std::string_view word) {
+      words[word].add(document);
+  }
+
+  void merge(DocumentCounter &&other) {
+      words.merge(other.words);
+  }
+
+  DocumentMap take() {
+      return std::move(words);
+  }
+
+ private:
+  DocumentMap words;
+  uint64_t document;
+};
+
+#endif //FREQ_SRC_DOCUMENTS_H
@@ -4,11 +4,12 @@
 #include <algorithm>
 
 #include "freq_dummy.h"
+#include "../token_filter.h"
 #include "../utils.h"
 
 FreqMap process_file_dummy(const std::string &filename) {
     const size_t file_size = std::filesystem::file_size(filename);
-    std::vector<char> data(file_size);
+    Buffer data(file_size);
 
     std::ifstream file;
     file.open(filename);
@@ -25,10 +26,9 @@ FreqMap process_file_dummy(const std::string &filename) {
 
     while (start_it < end_it) {
         auto word_end = std::find_if(start_it, end_it, is_delim);
-        const auto &x = std::string(start_it.base(), word_end - start_it);
-        const auto &[it, emplaced] = result.try_emplace(x, 1);
-        if (!emplaced) {
-            ++it->second;
+        const std::string_view word(start_it.base(), word_end - start_it);
+        if (is_counted(word)) {
+            ++result[word];
         }
         start_it = std::find_if_not(word_end, end_it, is_delim);
     }
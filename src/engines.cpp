@@ -0,0 +1,188 @@
+#include <chrono>
+#include <fcntl.h>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "engines.h"
+#include "freq.h"
+#include "dummy/freq_dummy.h"
+
+// Inputs below this size are counted without a thread pool.
+static constexpr size_t small_input_size = size_t{1} << 20;
+// Calibration counts this many bytes from the start of the input with every engine.
+static constexpr size_t calibration_sample_size = size_t{16} << 20;
+// Smaller inputs are not worth calibrating.
+static constexpr size_t calibrated_input_size = size_t{1} << 30;
+
+const std::vector<Engine> &engines() {
+    static const std::vector<Engine> registry{
+        {"blocking", process_file_blocking_read, true},
+        {"pipelined", process_file_pipelined, true},
+        {"direct", process_file_direct, true},
+#ifdef ENABLE_PROCESS_MMAPED_FILE
+        {"mmap", process_mmaped_file, true},
+#endif
+#ifdef HAS_LIBAIO
+        {"aio", process_file_aio, true},
+#endif
+        {"dummy", process_file_dummy, false},
+    };
+    return registry;
+}
+
+const Engine *find_engine(std::string_view name) {
+    for (const auto &engine : engines()) {
+        if (engine.name == name) {
+            return &engine;
+        }
+    }
+    return nullptr;
+}
+
+std::string get_profile_path() {
+    if (const char *cache = std::getenv("XDG_CACHE_HOME"); cache != nullptr && *cache != '\0') {
+        return std::string(cache) + "/freq/engines";
+    }
+    if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        return std::string(home) + "/.cache/freq/engines";
+    }
+    return {};
+}
+
+// Profile lines are "<device> <engine> <threads>".
+static std::optional<EngineChoice> load_profile(unsigned long long device) {
+    std::ifstream file(get_profile_path());
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        unsigned long long profile_device;
+        std::string name;
+        size_t threads;
+        if (fields >> profile_device >> name >> threads && profile_device == device && threads > 0) {
+            if (const Engine *engine = find_engine(name)) {
+                return EngineChoice{engine, threads};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+static void save_profile(unsigned long long device, const EngineChoice &choice) {
+    const std::string path = get_profile_path();
+    if (path.empty()) {
+        return;
+    }
+
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            unsigned long long profile_device;
+            if (fields >> profile_device && profile_device != device) {
+                lines.push_back(line);
+            }
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    std::ofstream file(path, std::ofstream::trunc);
+    for (const auto &line : lines) {
+        file << line << '\n';
+    }
+    file << device << ' ' << choice.engine->name << ' ' << choice.threads << '\n';
+}
+
+// Evicts the first size bytes of filename from the page cache, so that
+// they are read from the device again.
+static void drop_cached(const std::string &filename, size_t size) {
+#ifdef POSIX_FADV_DONTNEED
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, static_cast<off_t>(size), POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+// Counts a sample of the input with every parallel engine at all and half
+// of the cores and returns the fastest. Inputs worth calibrating are mostly
+// read cold, so the sample is evicted from the page cache before every run.
+static EngineChoice calibrate(const std::string &filename) {
+    auto &config = FreqConfig::instance();
+    const size_t processor_count = config.get_processor_count();
+    const size_t input_limit = config.get_input_limit();
+    config.set_input_limit(calibration_sample_size);
+
+    std::vector<size_t> thread_counts{processor_count};
+    if (processor_count >= 2) {
+        thread_counts.push_back(processor_count / 2);
+    }
+
+    EngineChoice best{find_engine("blocking"), processor_count};
+    auto best_time = std::chrono::steady_clock::duration::max();
+    for (const auto &engine : engines()) {
+        if (!engine.parallel) {
+            continue;
+        }
+        for (size_t threads : thread_counts) {
+            config.set_processor_count(threads);
+            drop_cached(filename, calibration_sample_size);
+            try {
+                const auto start = std::chrono::steady_clock::now();
+                engine.process(filename);
+                const auto time = std::chrono::steady_clock::now() - start;
+                if (time < best_time) {
+                    best_time = time;
+                    best = {&engine, threads};
+                }
+            } catch (const std::exception &) {
+                // Engine cannot read this file here, e.g. no kernel support.
+            }
+        }
+    }
+
+    config.set_processor_count(processor_count);
+    config.set_input_limit(input_limit);
+    return best;
+}
+
+EngineChoice choose_engine(const std::string &filename) {
+    const size_t processor_count = FreqConfig::instance().get_processor_count();
+    const size_t file_size = std::filesystem::file_size(filename);
+
+    if (file_size < small_input_size) {
+        return {find_engine("dummy"), 1};
+    }
+    if (processor_count <= 1) {
+        // Reads still overlap counting on one core, iostreams would hold the whole input.
+#ifdef HAS_LIBAIO
+        return {find_engine("aio"), 1};
+#else
+        return {find_engine("pipelined"), 1};
+#endif
+    }
+    if (file_size < calibrated_input_size) {
+        return {find_engine("blocking"), processor_count};
+    }
+
+    struct stat info{};
+    if (stat(filename.c_str(), &info) != 0) {
+        return {find_engine("blocking"), processor_count};
+    }
+    const auto device = static_cast<unsigned long long>(info.st_dev);
+    if (const auto cached = load_profile(device)) {
+        return *cached;
+    }
+    const auto choice = calibrate(filename);
+    save_profile(device, choice);
+    return choice;
+}
@@ -0,0 +1,38 @@
+#ifndef FREQ_SRC_ENGINES_H
+#define FREQ_SRC_ENGINES_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "utils.h"
+
+typedef FreqMap(*ProcessMethodType)(const std::string &filename);
+
+struct Engine {
+  std::string_view name;
+  ProcessMethodType process;
+  // Engine counts on FreqConfig::get_processor_count() threads.
+  bool parallel;
+};
+
+// Engines available in this build.
+const std::vector<Engine> &engines();
+
+// Returns nullptr if there is no engine called name.
+const Engine *find_engine(std::string_view name);
+
+struct EngineChoice {
+  const Engine *engine;
+  size_t threads;
+};
+
+// Small inputs are counted on one thread, larger ones by a pipelined engine
+// on a single core. Large ones go to the engine and thread count which were
+// fastest on a cold sample of an input from the same device, measured once
+// and kept in the profile cache.
+EngineChoice choose_engine(const std::string &filename);
+
+// Profiles are kept in $XDG_CACHE_HOME/freq/engines or ~/.cache/freq/engines.
+std::string get_profile_path();
+
+#endif //FREQ_SRC_ENGINES_H
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "fields.h"
+
+// First of [begin, end) equal to a or b, end if there is none.
+static const char *find_either(const char *begin, const char *end, char a, char b) {
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(a);
+    const __m128i second = _mm_set1_epi8(b);
+    for (; end - begin >= 16; begin += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, first), _mm_cmpeq_epi8(bytes, second)));
+        if (mask != 0) {
+            return begin + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    return std::find_if(begin, end, [a, b](char c) { return c == a || c == b; });
+}
+
+FieldScanner::FieldScanner(const std::vector<size_t> &fields, char separator) : separator(separator) {
+    for (const size_t field : fields) {
+        if (field > 0) {
+            selected.resize(std::max(selected.size(), field));
+            selected[field - 1] = 1;
+        }
+    }
+    in_selected = !selected.empty() && selected[0];
+}
+
+void FieldScanner::end_field(bool end_of_record, std::string &out) {
+    if (in_selected) {
+        out.push_back('\n');
+    }
+    field = end_of_record ? 0 : field + 1;
+    in_selected = field < selected.size() && selected[field];
+    state = State::field_start;
+}
+
+void FieldScanner::scan(std::span<const char> data, std::string &out) {
+    const char *p = data.data();
+    const char *const end = p + data.size();
+    while (p < end) {
+        switch (state) {
+            case State::field_start:
+                if (*p == '"') {
+                    if (in_selected) {
+                        out.push_back('"');
+                    }
+                    state = State::quoted;
+                    ++p;
+                    break;
+                }
+                state = State::unquoted;
+                [[fallthrough]];
+            case State::unquoted: {
+                const char *stop = find_either(p, end, separator, '\n');
+                if (in_selected) {
+                    out.append(p, stop);
+                }
+                p = stop;
+                if (stop < end) {
+                    end_field(*stop == '\n', out);
+                    ++p;
+                }
+                break;
+            }
+            case State::quoted: {
+                const auto *quote = static_cast<const char *>(std::memchr(p, '"', end - p));
+                const char *stop = quote == nullptr ? end : quote + 1;
+                if (in_selected) {
+                    out.append(p, stop);
+                }
+                if (quote != nullptr) {
+                    state = State::quoted_quote;
+                }
+                p = stop;
+                break;
+            }
+            case State::quoted_quote:
+                if (*p == '"') {
+                    if (in_selected) {
+                        out.push_back('"');
+                    }
+                    state = State::quoted;
+                    ++p;
+                } else {
+                    state = State::unquoted;
+                }
+                break;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef FREQ_SRC_FIELDS_H
+#define FREQ_SRC_FIELDS_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Extracts selected fields of separated records (CSV, TSV), fed in pieces
+// of any size: a record, a field or a quote may be split between pieces.
+// A field starting with '"' is quoted, as in RFC 4180: separators and
+// newlines up to its closing quote belong to it, and "" stands for a quote.
+// Separators and newlines are found 16 bytes at a time, fields which are
+// not selected are skipped without being copied.
+class FieldScanner {
+ public:
+  // fields are numbered from 1, as in cut(1).
+  FieldScanner(const std::vector<size_t> &fields, char separator);
+
+  // Appends the bytes of the selected fields of data to out, each field
+  // followed by '\n'. Quotes are kept, they are delimiters to the tokenizer.
+  void scan(std::span<const char> data, std::string &out);
+
+ private:
+  enum class State {
+    field_start,
+    unquoted,
+    quoted,
+    // A quote in a quoted field, closing it unless another one follows.
+    quoted_quote,
+  };
+
+  void end_field(bool end_of_record, std::string &out);
+
+  // selected[i] for field i from 0, fields past its end are not selected.
+  std::vector<uint8_t> selected;
+  char separator;
+  size_t field = 0;
+  bool in_selected = false;
+  State state = State::field_start;
+};
+
+#endif //FREQ_SRC_FIELDS_H
@@ -1,4 +1,7 @@
+#include <deque>
 #include <fstream>
+#include <future>
+#include <random>
 #include <filesystem>
 #include <ranges>
 #include <algorithm>
@@ -6,11 +9,20 @@
 #include <span>
 #include <unistd.h>
 #include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <coroutine>
+#include <cerrno>
+#include <cmath>
+#include <sys/stat.h>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 #ifdef HAS_LIBAIO
-#include <sys/param.h>
 #include <libaio.h>
 #include <iostream>
+#include <sstream>
 #endif
 
 #ifdef __linux__
@@ -21,264 +33,565 @@
 #endif
 
 #include "../libs/threadpool.h"
+#include "buffer_pool.h"
+#include "chunk_edge.h"
+#include "fields.h"
 #include "freq.h"
+#include "pipeline.h"
+#include "token_filter.h"
 #include "utils.h"
 
+// Chunks are sized for the thread count, but no larger than a read block:
+// blocks in flight are a few per thread, whatever the size of the input.
 static size_t get_chunk_size(const size_t file_size) {
     auto &config = FreqConfig::instance();
     return std::max(
         config.get_disk_page_size(),
-        file_size / (config.get_processor_count() * 4)
+        std::min(file_size / (config.get_processor_count() * 4), config.get_read_block_size())
     ) / config.get_disk_page_size() * config.get_disk_page_size();
 }
 
-static void count_word(FreqMap &freq, const char *begin, const char *end) {
-    const auto &x = std::string_view(begin, end - begin);
-    const auto &[it, emplaced] = freq.try_emplace(x, 1);
-    if (!emplaced) {
-        ++it->second;
-    }
+// Bytes of filename to count, the whole file unless the input is limited.
+static size_t get_input_size(const std::string &filename) {
+    return std::min<size_t>(std::filesystem::file_size(filename), FreqConfig::instance().get_input_limit());
 }
 
-static FreqMap process_edges(const std::span<char> &data,
-                             const std::vector<std::pair<const char *, const char *>> &chunk_edges) {
-    FreqMap result;
-    result.reserve(data.size() / 10);
-
-    const auto &[first_word_start, first_chunk_last_delim] = chunk_edges.front();
-    // Single chunk case is processed in else branch of var condition.
-    bool file_is_one_word = chunk_edges.size() > 1;
-
-    const char *left = first_word_start;
-    const char *right = nullptr;
+// Tables are presized for the words of a chunk, but distinct words stop
+// growing with input size, so huge chunks do not reserve by their size.
+static size_t get_reserve_size(const size_t chunk_size) {
+    return std::min<size_t>(chunk_size / 5, size_t{1} << 22);
+}
 
-    if (left == nullptr) {
-        // There were no delimiters in first chunk,
-        // hence whole chunk was a word, and it starts
-        // in the beginning of data vector
-        left = data.data();
+template<class Counter>
+static void count_word(Counter &freq, const char *begin, const char *end) {
+    const std::string_view word(begin, end - begin);
+    if (is_counted(word)) {
+        ++freq[word];
     }
+}
 
-    // Processing of words that have been split by chunk edges
-    for (auto chunk_it = chunk_edges.begin(); chunk_it != chunk_edges.end() - 1; ++chunk_it) {
-        auto &[curr_left, curr_right] = *chunk_it;
-        auto &[next_left, next_right] = *(chunk_it + 1);
-
-        // If current chunk is a whole word, then preserve start of the word
-        if (curr_right != nullptr) {
-            left = curr_right;
-        }
-
-        // If there was no end of the word, then set first correct end
-        if (right == nullptr && next_left != nullptr && left < next_left) {
-            right = next_left;
-        }
-
-        // Count word when found both start and end of the word
-        if (left != nullptr && right != nullptr) {
-            file_is_one_word = false;
-            count_word(result, left, right);
-            left = right = nullptr;
-        }
+static void count_word(VocabCounter &counter, const char *begin, const char *end) {
+    const std::string_view word(begin, end - begin);
+    if (is_counted(word)) {
+        counter.add(word);
     }
+}
 
-    if (file_is_one_word) {
-        // Processing the case of a huge single word.
-        const char *start_pos;
-        if (first_word_start != nullptr) {
-            start_pos = first_word_start + 1;
-        } else {
-            start_pos = std::find_if_not(data.begin(), data.end(), is_delim).base();
-        }
-        auto end_pos = std::find_if_not(data.rbegin(), data.rend(), is_delim).base().base();
-        count_word(result, start_pos, end_pos);
-    } else {
-        // Left edge of the first chunk
-        // first_word_start is null in case there were no delimiters in the chunk.
-        // first_word_start == data.data() in case file is starting with delimiter (no word in the beginning).
-        if (first_word_start != nullptr && first_word_start > data.data()) {
-            auto start_pos = std::find_if_not(data.begin(), data.end(), is_delim).base();
-            count_word(result, start_pos, first_word_start);
-        }
-
-        auto start_pos = chunk_edges.back().second;
-        // Right edge of the last chunk
-        // start_pos is null in case of there were no delimiters in chunk.
-        if (start_pos != nullptr && start_pos < &data.back()) {
-            count_word(result, start_pos, data.end().base());
-        } else if (start_pos == nullptr && left != nullptr && right == nullptr) {
-            count_word(result, left, data.end().base());
-        }
+static void count_word(DocumentCounter &counter, const char *begin, const char *end) {
+    const std::string_view word(begin, end - begin);
+    if (is_counted(word)) {
+        counter.add(word);
     }
-
-    return result;
 }
 
-static void process_chunk(const std::span<char> &data,
-                          FreqMap &freq_per_thread,
-                          std::vector<std::pair<const char *, const char *>> &chunk_edges,
-                          size_t start_pos, size_t end_pos, size_t chunk_size) {
-    std::transform(data.begin(), data.end(), data.begin(), [](char c) { return std::tolower(c); });
+static void count_word(SampleCounter &counter, const char *begin, const char *end) {
+    const std::string_view word(begin, end - begin);
+    if (is_counted(word)) {
+        counter.add(word);
+    }
+}
 
-    auto from = data.begin() + static_cast<std::ptrdiff_t>(start_pos);
-    auto to = data.begin() + static_cast<std::ptrdiff_t>(end_pos);
-    auto from_rev = std::reverse_iterator(to);
-    auto to_rev = std::reverse_iterator(from);
+// Inserts words in groups: hashes of the whole group are computed and
+// target buckets prefetched first, then the inserts run once the lines
+// have arrived, so cache misses overlap instead of stalling one by one.
+// Counters which cannot prefetch get the words passed through as is.
+// Words the token filter drops are never hashed.
+template<class Counter>
+class InsertBatch {
+ public:
+  explicit InsertBatch(Counter &counter)
+      : counter(counter),
+        filter(FreqConfig::instance().get_token_filter()),
+        entries(FreqConfig::instance().get_insert_batch_size()) {}
+
+  InsertBatch(const InsertBatch &) = delete;
+  InsertBatch &operator=(const InsertBatch &) = delete;
+
+  ~InsertBatch() {
+      flush();
+  }
+
+  void add(const char *begin, const char *end) {
+      if constexpr (can_prefetch) {
+          if (!entries.empty()) {
+              const std::string_view word(begin, end - begin);
+              if (filter != nullptr && !filter->accepts(word)) {
+                  return;
+              }
+              const uint64_t hash = Counter::hash(word);
+              counter.prefetch(word, hash);
+              entries[size++] = {word, hash};
+              if (size == entries.size()) {
+                  flush();
+              }
+              return;
+          }
+      }
+      count_word(counter, begin, end);
+  }
+
+  void flush() {
+      if constexpr (can_prefetch) {
+          for (size_t i = 0; i < size; ++i) {
+              ++counter.find_or_insert(entries[i].word, entries[i].hash);
+          }
+          size = 0;
+      }
+  }
+
+ private:
+  static constexpr bool can_prefetch = requires(Counter &c, std::string_view word, uint64_t hash) {
+      Counter::hash(word);
+      c.prefetch(word, hash);
+      c.find_or_insert(word, hash);
+  };
+
+  struct Entry {
+    std::string_view word;
+    uint64_t hash;
+  };
+
+  Counter &counter;
+  const TokenFilter *filter;
+  std::vector<Entry> entries;
+  size_t size = 0;
+};
+
+// Lowercases the chunk and counts words lying wholly inside it,
+// words cut by its edges are left to count_edge_words.
+template<class Counter>
+static ChunkEdge process_chunk(std::span<char> chunk, Counter &freq_per_thread) {
+    std::transform(chunk.begin(), chunk.end(), chunk.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    const char *begin = chunk.data();
+    const char *end = begin + chunk.size();
 
     // Looking for the first delimiter to cut off a word in the beginning.
-    auto start_it = std::find_if(from, to, is_delim);
+    const char *first_delim = std::find_if(begin, end, is_delim);
+    if (first_delim == end) {
+        return ChunkEdge::whole(begin, end);
+    }
 
     // Looking for the last delimiter to cut off a word in the ending.
-    auto end_it_rev = std::find_if(from_rev, to_rev, is_delim);
-    auto end_it = end_it_rev.base();
-
-    // In this case nullptr means no delimiter was found in the chunk
-    // (the whole chunk is part of the word).
-    char *start = nullptr;
-    char *end = nullptr;
-
-    if (start_it != to) {
-        start = start_it.base();
-        if (end_it_rev != to_rev) {
-            end = end_it.base();
-        }
-
-        chunk_edges[start_pos / chunk_size] = {start, end};
-
-        start_it = std::find_if_not(start_it, end_it, is_delim);
-        while (start_it < end_it) {
-            auto word_end = std::find_if(start_it, end_it, is_delim);
-            count_word(freq_per_thread, start_it.base(), word_end.base());
-            start_it = std::find_if_not(word_end, end_it, is_delim);
-        }
+    const char *last_delim_end = std::find_if(
+        std::reverse_iterator(end), std::reverse_iterator(first_delim), is_delim
+    ).base();
+
+    InsertBatch batch(freq_per_thread);
+    auto start_it = std::find_if_not(first_delim, last_delim_end, is_delim);
+    while (start_it < last_delim_end) {
+        auto word_end = std::find_if(start_it, last_delim_end, is_delim);
+        batch.add(start_it, word_end);
+        start_it = std::find_if_not(word_end, last_delim_end, is_delim);
     }
+
+    return ChunkEdge::split(begin, first_delim, last_delim_end, end);
 }
 
-FreqMap process_file_blocking_read(const std::string &filename) {
-    const auto &config = FreqConfig::instance();
-    const size_t file_size = std::filesystem::file_size(filename);
+ChunkEdge count_chunk(std::span<char> chunk, FreqMap &words) {
+    return process_chunk(chunk, words);
+}
 
-    const size_t chunk_size = get_chunk_size(file_size);
+// Counter of lossy counting: a WordMap which drops the words counted once
+// since they were inserted, whenever it has doubled since it was last pruned
+// and at least 1 / error words were counted meanwhile. A word loses at most
+// one occurrence per pruning, so its count is at most error * words short.
+class LossyCounter {
+ public:
+  LossyCounter() {
+      const double error = FreqConfig::instance().get_lossy_error();
+      if (error > 0) {
+          spacing = static_cast<size_t>(std::ceil(1 / error));
+      }
+  }
+
+  void reserve(size_t n) {
+      words.reserve(n);
+  }
+
+  size_t &operator[](std::string_view word) {
+      return find_or_insert(word, WordMap::hash(word));
+  }
+
+  [[nodiscard]] static uint64_t hash(std::string_view word) {
+      return WordMap::hash(word);
+  }
+
+  void prefetch(std::string_view word, uint64_t hash) const {
+      words.prefetch(word, hash);
+  }
+
+  size_t &find_or_insert(std::string_view word, uint64_t hash) {
+      if (++counted - pruned_at >= spacing && words.size() >= prune_size) {
+          words.retain([](std::string_view, size_t count) { return count > 1; });
+          pruned_at = counted;
+          prune_size = std::max(2 * words.size(), min_prune_size);
+      }
+      return words.find_or_insert(word, hash);
+  }
+
+  void merge(LossyCounter &&other) {
+      words.merge(other.words);
+      other.words = WordMap();
+  }
+
+  WordMap take() {
+      return std::move(words);
+  }
+
+ private:
+  // Smaller tables are not worth pruning.
+  static constexpr size_t min_prune_size = size_t{1} << 16;
+
+  WordMap words;
+  size_t spacing = std::numeric_limits<size_t>::max();
+  size_t counted = 0;
+  size_t pruned_at = 0;
+  size_t prune_size = min_prune_size;
+};
+
+// Counter of documents which are lines. Chunks are cut into lines instead
+// of words: lines lying wholly inside a chunk are counted by process_chunk(),
+// lines cut by its ends are left in its edge and counted by count_word()
+// once stitched.
+class LineDocuments {
+ public:
+  explicit LineDocuments(uint64_t first_document = 0)
+      : counter(first_document), filter(FreqConfig::instance().get_token_filter()) {}
+
+  void reserve(size_t n) {
+      counter.reserve(n);
+  }
+
+  void merge(LineDocuments &&other) {
+      counter.merge(std::move(other.counter));
+  }
+
+  void add_line(const char *begin, const char *end) {
+      counter.begin_document();
+      auto word = std::find_if_not(begin, end, is_delim);
+      while (word < end) {
+          auto word_end = std::find_if(word, end, is_delim);
+          if (filter == nullptr || filter->accepts(std::string_view(word, word_end - word))) {
+              counter.add(std::string_view(word, word_end - word));
+          }
+          word = std::find_if_not(word_end, end, is_delim);
+      }
+  }
+
+  DocumentMap take() {
+      return counter.take();
+  }
+
+ private:
+  DocumentCounter counter;
+  const TokenFilter *filter;
+};
+
+static void count_word(LineDocuments &lines, const char *begin, const char *end) {
+    lines.add_line(begin, end);
+}
 
-    const size_t chunks = (file_size + chunk_size - 1) / chunk_size;
+static ChunkEdge process_chunk(std::span<char> chunk, LineDocuments &lines) {
+    std::transform(chunk.begin(), chunk.end(), chunk.begin(), [](unsigned char c) { return std::tolower(c); });
 
-    std::vector<char> data(file_size);
+    const char *begin = chunk.data();
+    const char *end = begin + chunk.size();
+    const char *first_newline = std::find(begin, end, '\n');
+    if (first_newline == end) {
+        return ChunkEdge::whole(begin, end);
+    }
+    const char *last_line = std::find(std::reverse_iterator(end), std::reverse_iterator(first_newline), '\n').base();
 
-    // Words can lie on the boundaries of chunks, so it is
-    // necessary to memorize parts of words on the boundaries.
-    // chunk_edges stores the first and last delimiter position in each chunk.
-    std::vector<std::pair<const char *, const char *>> chunk_edges(chunks);
+    for (const char *line = first_newline + 1; line < last_line;) {
+        const char *line_end = std::find(line, last_line, '\n');
+        lines.add_line(line, line_end);
+        line = line_end + 1;
+    }
+    return ChunkEdge::split(begin, first_newline, last_line, end);
+}
 
-    struct PerThreadData {
-      std::ifstream file;
-      FreqMap frequency;
+// Counts words split by chunk edges, chunk_edges are in file order.
+template<class Counter>
+static void count_edge_words(Counter &result, const std::vector<ChunkEdge> &chunk_edges) {
+    const auto count = [&result](std::string_view word) {
+      count_word(result, word.data(), word.data() + word.size());
     };
+    finish(stitch_all(chunk_edges, count), count);
+}
 
-    std::vector<PerThreadData> per_thread(config.get_processor_count());
-    for (auto &tld : per_thread) {
-        // To prevent sharing of position state, it is necessary
-        // to allocate a unique file descriptor (fd) per thread.
-        tld.file.open(filename, std::ifstream::binary);
-        tld.frequency.reserve(chunk_size / 5);
+// Merges per-thread counters into the first one, which is already sized for the data.
+template<class Counter>
+static Counter merge_per_thread(std::vector<Counter> &per_thread) {
+    Counter result = std::move(per_thread.front());
+    for (auto frequency = per_thread.begin() + 1; frequency != per_thread.end(); ++frequency) {
+        result.merge(std::move(*frequency));
     }
+    return result;
+}
 
-    {
-        auto thread_pool = ThreadPool(config.get_processor_count());
-
-        for (size_t i = 0; i < chunks; i++) {
-            thread_pool.enqueue([&, i, file_size](const size_t thread_index) {
-              const size_t start_pos = i * chunk_size;
-              const size_t end_pos = (i == chunks - 1)
-                                     ? file_size
-                                     : start_pos + chunk_size;
-              const size_t size = end_pos - start_pos;
-
-              auto &tld = per_thread[thread_index];
-
-              tld.file.seekg(static_cast<int>(start_pos));
-              tld.file.read(data.data() + start_pos, static_cast<int>(size));
-
-              process_chunk(data, tld.frequency, chunk_edges, start_pos, end_pos, chunk_size);
-            });
+// Reads exactly size bytes at offset, short reads are continued.
+static void read_at(int fd, char *buffer, size_t size, size_t offset) {
+    while (size > 0) {
+        const ssize_t n = pread(fd, buffer, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
-    }
-
-    FreqMap result = process_edges(std::span(data), chunk_edges);
-
-    for (auto &tld : per_thread) {
-        for (auto &[key, value] : tld.frequency) {
-            result[key] += value;
+        if (n <= 0) {
+            throw std::runtime_error("pread failed at offset " + std::to_string(offset));
         }
+        buffer += n;
+        size -= n;
+        offset += n;
     }
-
-    return result;
 }
 
-#ifdef ENABLE_PROCESS_MMAPED_FILE
-FreqMap process_mmaped_file(const std::string &filename) {
-    const auto &config = FreqConfig::instance();
-    const size_t file_size = std::filesystem::file_size(filename);
-
-    int fd = open(filename.c_str(), O_RDONLY | O_DIRECT | O_NOATIME);
-    char *mmaped = static_cast<char *>(
-        mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0)
-    );
-
-    if (mmaped == MAP_FAILED) {
-        std::cerr << "mmap failed: " << std::strerror(errno) << std::endl;
-        close(fd);
-        std::exit(EXIT_FAILURE);
+static int open_file(const std::string &filename, int flags) {
+    const int fd = open(filename.c_str(), O_RDONLY | flags);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + filename + ": " + std::strerror(errno));
     }
+    return fd;
+}
 
-    const std::span<char> data(mmaped, file_size);
+// Opens filename for O_DIRECT reads and sets alignment to what the file
+// system requires of offsets, lengths and memory, returns -1 if the file
+// cannot be read directly.
+static int open_direct(const std::string &filename, size_t &alignment) {
+    alignment = 4096;
+#ifdef O_DIRECT
+    const int fd = open(filename.c_str(), O_RDONLY | O_DIRECT);
+    if (fd < 0) {
+        return -1;
+    }
+#ifdef STATX_DIOALIGN
+    struct statx info{};
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &info) == 0 && (info.stx_mask & STATX_DIOALIGN)) {
+        if (info.stx_dio_offset_align == 0) {
+            close(fd);
+            return -1;
+        }
+        alignment = std::max(info.stx_dio_mem_align, info.stx_dio_offset_align);
+    }
+#endif
+    return fd;
+#else
+    return -1;
+#endif
+}
 
-    const size_t chunk_size = get_chunk_size(file_size);
+static char *align_up(char *ptr, size_t alignment) {
+    const auto address = reinterpret_cast<uintptr_t>(ptr);
+    return reinterpret_cast<char *>((address + alignment - 1) / alignment * alignment);
+}
 
-    const size_t chunks = (file_size + chunk_size - 1) / chunk_size;
+// Returns a buffer to its pool however the block using it ends.
+class BufferLease {
+ public:
+  BufferLease(BufferPool &pool, Buffer &buffer) : pool(pool), buffer(buffer) {}
+
+  BufferLease(const BufferLease &) = delete;
+  BufferLease &operator=(const BufferLease &) = delete;
+
+  ~BufferLease() {
+      pool.release(buffer);
+  }
+
+ private:
+  BufferPool &pool;
+  Buffer &buffer;
+};
+
+// Sources of blocks, awaited by the pipeline:
+//   block_size(size)             block size the source can read, at least size;
+//   buffer_size(block_size)      bytes of a buffer for a block, 0 if the source needs none;
+//   will_need(offset, size)      hint of the bytes to be read next;
+//   executor()                   where reads are started;
+//   read(buffer, size, offset)   awaitable of a pointer to size bytes of the file at offset.
+
+// Reads blocks through the page cache on the threads of an executor,
+// hinting the kernel to read ahead.
+class BufferedSource {
+ public:
+  BufferedSource(const std::string &filename, Executor &readers) : readers(readers), fd(open_file(filename, 0)) {
+#ifdef POSIX_FADV_SEQUENTIAL
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
 
-    // Words can lie on the boundaries of chunks, so it is
-    // necessary to memorize parts of words on the boundaries.
-    // chunk_edges stores the first and last delimiter position in each chunk.
-    std::vector<std::pair<const char *, const char *>> chunk_edges(chunks);
+  BufferedSource(const BufferedSource &) = delete;
+  BufferedSource &operator=(const BufferedSource &) = delete;
 
-    struct PerThreadData {
-      FreqMap frequency;
-    };
+  ~BufferedSource() {
+      close(fd);
+  }
 
-    std::vector<PerThreadData> per_thread(config.get_processor_count());
-    for (auto &tld : per_thread) {
-        tld.frequency.reserve(chunk_size / 5);
-    }
+  [[nodiscard]] size_t block_size(size_t size) const {
+      return size;
+  }
 
-    {
-        auto thread_pool = ThreadPool(config.get_processor_count());
+  [[nodiscard]] size_t buffer_size(size_t block_size) const {
+      return block_size;
+  }
 
-        for (size_t i = 0; i < chunks; i++) {
-            thread_pool.enqueue([&, i, file_size](const size_t thread_index) {
-              const size_t start_pos = i * chunk_size;
-              const size_t end_pos = (i == chunks - 1)
-                                     ? file_size
-                                     : start_pos + chunk_size;
+  void will_need(size_t offset, size_t size) const {
+#ifdef POSIX_FADV_WILLNEED
+      posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+#endif
+  }
+
+  [[nodiscard]] Executor &executor() const {
+      return readers;
+  }
+
+  auto read(Buffer &buffer, size_t size, size_t offset) const {
+      return readers.run([this, &buffer, size, offset] {
+        read_at(fd, buffer.data(), size, offset);
+        return buffer.data();
+      });
+  }
+
+ private:
+  Executor &readers;
+  int fd;
+};
+
+
+// Reads blocks with O_DIRECT on the threads of an executor, bypassing the
+// page cache, so one-shot inputs do not evict data of other processes.
+// Offsets, lengths and memory are aligned as the file system requires,
+// the unaligned tail of the file goes through a buffered descriptor.
+// Falls back to buffered reads where the file system has no direct I/O.
+class DirectSource {
+ public:
+  DirectSource(const std::string &filename, Executor &readers) : readers(readers), buffered_fd(open_file(filename, 0)) {
+      direct_fd = open_direct(filename, alignment);
+  }
+
+  DirectSource(const DirectSource &) = delete;
+  DirectSource &operator=(const DirectSource &) = delete;
+
+  ~DirectSource() {
+      if (direct_fd >= 0) {
+          close(direct_fd);
+      }
+      close(buffered_fd);
+  }
+
+  [[nodiscard]] size_t block_size(size_t size) const {
+      return (size + alignment - 1) / alignment * alignment;
+  }
+
+  [[nodiscard]] size_t buffer_size(size_t block_size) const {
+      return block_size + alignment;
+  }
+
+  // Nothing to read ahead into, the page cache is not used.
+  void will_need(size_t, size_t) const {}
+
+  [[nodiscard]] Executor &executor() const {
+      return readers;
+  }
+
+  auto read(Buffer &buffer, size_t size, size_t offset) const {
+      return readers.run([this, &buffer, size, offset] {
+        char *data = align_up(buffer.data(), alignment);
+        if (direct_fd < 0) {
+            read_at(buffered_fd, data, size, offset);
+            return data;
+        }
 
-              auto &tld = per_thread[thread_index];
-              process_chunk(data, tld.frequency, chunk_edges, start_pos, end_pos, chunk_size);
-            });
+        const size_t aligned_size = size / alignment * alignment;
+        read_at(direct_fd, data, aligned_size, offset);
+        if (aligned_size < size) {
+            read_at(buffered_fd, data + aligned_size, size - aligned_size, offset + aligned_size);
+#ifdef POSIX_FADV_DONTNEED
+            posix_fadvise(buffered_fd, static_cast<off_t>(offset + aligned_size), 0, POSIX_FADV_DONTNEED);
+#endif
         }
-    }
+        return data;
+      });
+  }
 
-    FreqMap result = process_edges(data, chunk_edges);
+ private:
+  Executor &readers;
+  int buffered_fd;
+  int direct_fd;
+  size_t alignment;
+};
 
-    for (auto &tld : per_thread) {
-        for (auto &[key, value] : tld.frequency) {
-            result[key] += value;
+#ifdef ENABLE_PROCESS_MMAPED_FILE
+// Blocks are views of a private mapping of the file, pages are read
+// when the counting threads fault them in.
+class MmapSource {
+ public:
+  MmapSource(const std::string &filename, Executor &executor, size_t size)
+      : counters(executor), fd(open_file(filename, 0)), size(size) {
+      if (size == 0) {
+          return;
+      }
+      // Private pages, blocks are lowercased in place.
+      void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+          const int error = errno;
+          close(fd);
+          throw std::runtime_error("cannot map " + filename + ": " + std::strerror(error));
+      }
+      mapping = static_cast<char *>(mapped);
+      madvise(mapping, size, MADV_SEQUENTIAL);
+  }
+
+  MmapSource(const MmapSource &) = delete;
+  MmapSource &operator=(const MmapSource &) = delete;
+
+  ~MmapSource() {
+      if (mapping != nullptr) {
+          munmap(mapping, size);
+      }
+      close(fd);
+  }
+
+  [[nodiscard]] size_t block_size(size_t block) const {
+      return block;
+  }
+
+  [[nodiscard]] size_t buffer_size(size_t) const {
+      return 0;
+  }
+
+  void will_need(size_t offset, size_t length) const {
+      const size_t page = FreqConfig::instance().get_disk_page_size();
+      const size_t start = offset / page * page;
+      madvise(mapping + start, std::min(offset + length, size) - start, MADV_WILLNEED);
+  }
+
+  [[nodiscard]] Executor &executor() const {
+      return counters;
+  }
+
+  auto read(Buffer &, size_t, size_t offset) const {
+      struct Awaiter {
+        char *data;
+
+        [[nodiscard]] bool await_ready() const {
+            return true;
         }
-    }
 
-    munmap(mmaped, file_size);
-    close(fd);
+        void await_suspend(std::coroutine_handle<>) const {}
 
-    return result;
-}
+        [[nodiscard]] char *await_resume() const {
+            return data;
+        }
+      };
+      return Awaiter{mapping + offset};
+  }
+
+ private:
+  Executor &counters;
+  int fd;
+  size_t size;
+  char *mapping = nullptr;
+};
 #endif
 
 #ifdef HAS_LIBAIO
@@ -292,109 +605,546 @@ static void io_error(const char *func, int rc) {
     throw std::runtime_error(err.str());
 }
 
-static void validate_event(const io_event &event) {
+static void validate_event(const io_event &event, size_t expected) {
+    const auto res = static_cast<long>(event.res);
+    if (res < 0) {
+        io_error("aio read", static_cast<int>(res));
+    }
     if (event.res2 != 0) {
         io_error("aio read", static_cast<int>(event.res2));
     }
-    if (event.res != event.obj->u.c.nbytes) {
+    // The last block of a limited input may read past the limit.
+    if (static_cast<size_t>(res) < expected) {
         std::stringstream err;
-        err << "read missing bytes expect " << event.obj->u.c.nbytes << " got " << event.res;
+        err << "read missing bytes expect " << expected << " got " << res;
         throw std::runtime_error(err.str());
     }
 }
 
-FreqMap process_file_aio(const std::string &filename) {
-    const size_t file_size = std::filesystem::file_size(filename);
-    constexpr auto to_lower_power_of_2 = [](unsigned int v) {
-      v--;
-      v |= v >> 1;
-      v |= v >> 2;
-      v |= v >> 4;
-      v |= v >> 8;
-      v |= v >> 16;
-      v++;
-      return v / 2;
-    };
 
-    const size_t AIO_BLKSIZE = to_lower_power_of_2(file_size / 2);
-    constexpr size_t AIO_MAXIO = 32;
+// Keeps reads in flight in the kernel with libaio. A completion thread
+// sleeps in io_getevents and resumes the blocks whose reads complete,
+// which then move on to the counting threads.
+class AioSource {
+ public:
+  AioSource(const std::string &filename, Executor &executor, size_t depth) : counters(executor) {
+      // Reads are asynchronous only with O_DIRECT, the page cache is used where it is not supported.
+      fd = open_direct(filename, alignment);
+      if (fd < 0) {
+          alignment = 1;
+          fd = open_file(filename, 0);
+      }
+      const int rc = io_queue_init(static_cast<int>(std::max<size_t>(depth, 1)), &ctx);
+      if (rc < 0) {
+          close(fd);
+          io_error("io_queue_init", rc);
+      }
+      completions = std::thread([this] { complete_reads(); });
+  }
+
+  AioSource(const AioSource &) = delete;
+  AioSource &operator=(const AioSource &) = delete;
+
+  ~AioSource() {
+      stopping = true;
+      completions.join();
+      io_destroy(ctx);
+      close(fd);
+  }
+
+  [[nodiscard]] size_t block_size(size_t size) const {
+      return round_up(size);
+  }
+
+  // The last block may be shorter, but is read with an aligned length.
+  [[nodiscard]] size_t buffer_size(size_t block_size) const {
+      return round_up(block_size) + alignment;
+  }
+
+  void will_need(size_t, size_t) const {}
+
+  [[nodiscard]] Executor &executor() const {
+      return counters;
+  }
+
+  class Read {
+   public:
+    Read(AioSource &source, char *data, size_t size, size_t offset)
+        : source(source), data(data), size(size), offset(offset) {}
+
+    [[nodiscard]] bool await_ready() const {
+        return false;
+    }
 
-    std::vector<char> data(file_size);
+    bool await_suspend(std::coroutine_handle<> h) {
+        handle = h;
+        // The last block is read with an aligned length, the read stops at the end of file.
+        io_prep_pread(&cb, source.fd, data, source.round_up(size), static_cast<long long>(offset));
+        cb.data = this;
+        ++source.in_flight;
+        iocb *request = &cb;
+        const int rc = io_submit(source.ctx, 1, &request);
+        if (rc == 1) {
+            // May be resumed by now, the read is not touched any more.
+            return true;
+        }
+        --source.in_flight;
+        fail("io_submit", rc);
+        return false;
+    }
 
-    FreqMap frequency;
-    frequency.reserve(file_size / 3);
+    char *await_resume() const {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return data;
+    }
 
-    size_t length, offset = 0;
+   private:
+    friend class AioSource;
 
-    int fd;
-    if ((fd = open(filename.c_str(), O_RDONLY | O_DIRECT | O_NOATIME)) < 0) {
-        perror(filename.c_str());
-        std::exit(EXIT_FAILURE);
+    void fail(const char *func, int rc) {
+        try {
+            io_error(func, rc);
+        } catch (...) {
+            error = std::current_exception();
+        }
     }
-    length = file_size;
 
-    io_context_t ctx{};
-    io_queue_init(AIO_MAXIO, &ctx);
-    size_t busy = 0;
-    size_t chunks = howmany(length, AIO_BLKSIZE);
+    AioSource &source;
+    char *data;
+    size_t size;
+    size_t offset;
+    iocb cb{};
+    std::coroutine_handle<> handle;
+    std::exception_ptr error;
+  };
+
+  Read read(Buffer &buffer, size_t size, size_t offset) {
+      return Read(*this, align_up(buffer.data(), alignment), size, offset);
+  }
+
+ private:
+  [[nodiscard]] size_t round_up(size_t size) const {
+      return (size + alignment - 1) / alignment * alignment;
+  }
+
+  // Runs until the source is destroyed, which is after its last read.
+  void complete_reads() {
+      std::vector<io_event> events(64);
+      while (!stopping || in_flight > 0) {
+          // Wakes up now and then to notice the end.
+          timespec timeout{0, 10'000'000};
+          const int ret = io_getevents(ctx, 1, static_cast<long>(events.size()), events.data(), &timeout);
+          if (ret == -EINTR) {
+              continue;
+          }
+          if (ret < 0) {
+              // Reads in flight cannot be found any more.
+              std::terminate();
+          }
+          for (int i = 0; i < ret; ++i) {
+              auto &read = *static_cast<Read *>(events[i].data);
+              try {
+                  validate_event(events[i], read.size);
+              } catch (...) {
+                  read.error = std::current_exception();
+              }
+              --in_flight;
+              read.handle.resume();
+          }
+      }
+  }
+
+  Executor &counters;
+  int fd = -1;
+  size_t alignment = 1;
+  io_context_t ctx{};
+  std::atomic<size_t> in_flight = 0;
+  std::atomic<bool> stopping = false;
+  std::thread completions;
+};
+#endif
 
-    std::vector<std::pair<const char *, const char *>> chunk_edges(chunks);
+// Blocks of bytes [begin, end) are counted by depth coroutines, which take
+// the next block in order once done with one: a coroutine waits for a
+// buffer, for the block's data from the source and for a counting thread
+// of workers, which returns the buffer once done. Reading of the next
+// blocks overlaps with counting of the previous ones, whatever the source,
+// and memory in flight, coroutine frames included, stays bounded by depth
+// whatever the size of the range. Words cut by the ends of the range are
+// not counted but returned in its edge.
+template<class Counter, class Source>
+class BlockPipeline {
+ public:
+  template<class MakeCounter>
+  BlockPipeline(Source &source, Executor &workers, MakeCounter make_counter,
+                size_t begin, size_t end, size_t block_size, size_t depth)
+      : source(source), workers(workers), begin(begin), range_size(end - begin),
+        block_size(source.block_size(std::max<size_t>(block_size, 1))),
+        blocks((range_size + this->block_size - 1) / this->block_size),
+        depth(std::max<size_t>(depth, 1)),
+        chunk_edges(blocks),
+        per_thread(workers.size()),
+        buffers(std::min(this->depth, blocks), source.buffer_size(std::min(this->block_size, range_size))) {
+      for (auto &frequency : per_thread) {
+          frequency = make_counter();
+          frequency.reserve(get_reserve_size(std::min(this->block_size, get_chunk_size(range_size))));
+      }
+  }
+
+  std::pair<Counter, OwnedChunkEdge> run() {
+      source.will_need(begin, std::min(range_size, depth * block_size));
+      for (size_t i = 0; i < std::min(depth, blocks); ++i) {
+          tasks.spawn(count_blocks());
+      }
+      tasks.wait();
+
+      Counter result = merge_per_thread(per_thread);
+      std::string edge_storage;
+      const auto edge = stitch_all(join_edges(chunk_edges, edge_storage), [&result](std::string_view word) {
+        count_word(result, word.data(), word.data() + word.size());
+      });
+      return {std::move(result), OwnedChunkEdge(edge)};
+  }
+
+ private:
+  TaskGroup::Task count_blocks() {
+      for (size_t i = next_block++; i < blocks; i = next_block++) {
+          Buffer &buffer = co_await buffers.acquire(source.executor());
+          const BufferLease lease(buffers, buffer);
+          if (tasks.failed()) {
+              co_return;
+          }
+
+          const size_t offset = i * block_size;
+          const size_t size = std::min(block_size, range_size - offset);
+          if (i + depth < blocks) {
+              source.will_need(begin + offset + depth * block_size, block_size);
+          }
+          char *data = co_await source.read(buffer, size, begin + offset);
+
+          const size_t thread_index = co_await workers.schedule();
+          // Buffers are reused, so parts of words on the boundaries are copied.
+          chunk_edges[i] = OwnedChunkEdge(process_chunk(std::span(data, size), per_thread[thread_index]));
+      }
+  }
+
+  Source &source;
+  Executor &workers;
+  size_t begin;
+  size_t range_size;
+  size_t block_size;
+  size_t blocks;
+  size_t depth;
+  std::vector<OwnedChunkEdge> chunk_edges;
+  std::vector<Counter> per_thread;
+  BufferPool buffers;
+  // Next block for a coroutine to take.
+  std::atomic<size_t> next_block = 0;
+  TaskGroup tasks;
+};
+
+template<class Counter, class MakeCounter, class Source>
+static std::pair<Counter, OwnedChunkEdge> count_range(Source &source, Executor &workers, MakeCounter make_counter,
+                                                      size_t begin, size_t end, size_t block_size, size_t depth) {
+    return BlockPipeline<Counter, Source>(source, workers, make_counter, begin, end, block_size, depth).run();
+}
 
-    iocb iocbs[AIO_MAXIO];
-    io_event events[AIO_MAXIO];
+// Counts the whole input, words on its ends included.
+template<class Counter, class MakeCounter, class Source>
+static Counter count_input(Source &source, Executor &workers, MakeCounter make_counter,
+                           size_t input_size, size_t block_size, size_t depth) {
+    auto [result, edge] = count_range<Counter>(source, workers, make_counter, 0, input_size, block_size, depth);
+    finish(ChunkEdge{edge.whole_word, edge.left, edge.right}, [&result](std::string_view word) {
+      count_word(result, word.data(), word.data() + word.size());
+    });
+    return std::move(result);
+}
 
-    iocb *iocbs_ptrs[AIO_MAXIO];
-    for (size_t i = 0; i < AIO_MAXIO; ++i) {
-        iocbs_ptrs[i] = &iocbs[i];
+// Counting threads read their blocks themselves, chunks of the input
+// sized for the thread count, each thread with one more in flight.
+template<class Counter, class MakeCounter>
+static Counter blocking_read(const std::string &filename, MakeCounter make_counter) {
+    const size_t file_size = get_input_size(filename);
+    const size_t threads = FreqConfig::instance().get_processor_count();
+    Executor workers(threads, 2 * threads);
+    BufferedSource source(filename, workers);
+    return count_input<Counter>(source, workers, make_counter, file_size, get_chunk_size(file_size), 2 * threads);
+}
+
+FreqMap process_file_blocking_read(const std::string &filename) {
+    return blocking_read<FreqMap>(filename, [] { return FreqMap(); });
+}
+
+WordTree process_file_blocking_read_tree(const std::string &filename) {
+    return blocking_read<WordTree>(filename, [] { return WordTree(); });
+}
+
+FreqMap process_file_blocking_read_vocab(const std::string &filename, const Vocabulary &vocabulary) {
+    return blocking_read<VocabCounter>(filename, [&] { return VocabCounter(vocabulary); }).to_freq_map();
+}
+
+// Dedicated reader threads stay read-ahead blocks ahead of the counting threads.
+template<class Counter, class Source, class MakeCounter>
+static Counter pipelined_read(const std::string &filename, MakeCounter make_counter) {
+    const auto &config = FreqConfig::instance();
+    const size_t depth = std::max<size_t>(config.get_read_ahead(), 1);
+    Executor workers(config.get_processor_count(), depth);
+    Executor readers(std::max<size_t>(config.get_reader_count(), 1), depth);
+    Source source(filename, readers);
+    return count_input<Counter>(source, workers, make_counter, get_input_size(filename),
+                                config.get_read_block_size(), config.get_read_ahead());
+}
+
+std::pair<FreqMap, OwnedChunkEdge> process_file_range(const std::string &filename, size_t begin, size_t end) {
+    const auto &config = FreqConfig::instance();
+    const size_t depth = std::max<size_t>(config.get_read_ahead(), 1);
+    Executor workers(config.get_processor_count(), depth);
+    Executor readers(std::max<size_t>(config.get_reader_count(), 1), depth);
+    BufferedSource source(filename, readers);
+    if (config.get_lossy_error() > 0) {
+        auto [words, edge] = count_range<LossyCounter>(source, workers, [] { return LossyCounter(); }, begin, end,
+                                                       config.get_read_block_size(), config.get_read_ahead());
+        return {words.take(), std::move(edge)};
     }
+    return count_range<FreqMap>(source, workers, [] { return FreqMap(); }, begin, end,
+                                config.get_read_block_size(), config.get_read_ahead());
+}
 
-    while (chunks > 0) {
-        int ret;
-        const int n = MIN(MIN(AIO_MAXIO - busy, AIO_MAXIO / 2),
-                          howmany(length - offset, AIO_BLKSIZE));
-        if (n > 0) {
-            for (size_t i = 0; i < n; i++) {
-                const size_t size = std::min(length - offset, AIO_BLKSIZE);
-                char *buf = data.data() + offset;
-                io_prep_pread(&iocbs[i], fd, buf, size, static_cast<off_t>(offset));
-                offset += size;
-            }
-            ret = io_submit(ctx, n, iocbs_ptrs);
-            if (ret < 0) {
-                io_error("io_submit", ret);
-            }
-            busy += n;
+DocumentMap process_files_documents(const std::vector<std::string> &filenames, bool line_documents) {
+    DocumentMap result;
+    uint64_t counters = 0;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        DocumentMap file;
+        if (line_documents) {
+            // Every counter numbers lines from its own range of ids.
+            file = blocking_read<LineDocuments>(filenames[i], [&] { return LineDocuments(++counters << 40); }).take();
+        } else {
+            // Counters of a file all count its one document.
+            file = blocking_read<DocumentCounter>(filenames[i], [i] { return DocumentCounter(i + 1); }).take();
         }
+        if (result.empty()) {
+            result = std::move(file);
+        } else {
+            result.merge(file);
+        }
+    }
+    return result;
+}
 
-        static timespec timeout = {0, 0};
-        while ((ret = io_getevents(ctx, 0, n, events, &timeout)) > 0) {
-            for (size_t i = 0; i < ret; ++i) {
-                const io_event &event = events[i];
-                validate_event(event);
+FreqMap process_file_pipelined(const std::string &filename) {
+    return pipelined_read<FreqMap, BufferedSource>(filename, [] { return FreqMap(); });
+}
 
-                iocb *iocb = event.obj;
-                const auto start_pos = iocb->u.c.offset;
-                const auto size = iocb->u.c.nbytes;
+FreqMap process_file_direct(const std::string &filename) {
+    return pipelined_read<FreqMap, DirectSource>(filename, [] { return FreqMap(); });
+}
 
-                --busy;
-                --chunks;
-                const auto end_pos = start_pos + size;
-                process_chunk(data, frequency, chunk_edges, start_pos, end_pos, AIO_BLKSIZE);
-            }
+FreqMap process_file_lossy(const std::string &filename) {
+    return pipelined_read<LossyCounter, BufferedSource>(filename, [] { return LossyCounter(); }).take();
+}
+
+// Reads and counts sampled blocks of a file. A word belongs to the block
+// it starts in: one running into a block is left to the block before,
+// the one cut by the end of a block is read on to its end.
+class SampledBlocks {
+ public:
+  SampledBlocks(const std::string &filename, size_t file_size)
+      : fd(open_file(filename, 0)), file_size(file_size) {
+#ifdef POSIX_FADV_RANDOM
+      posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+  }
+
+  SampledBlocks(const SampledBlocks &) = delete;
+  SampledBlocks &operator=(const SampledBlocks &) = delete;
+
+  ~SampledBlocks() {
+      close(fd);
+  }
+
+  // Counts bytes [begin, end) in buffer, whose storage is reused between blocks.
+  void count(size_t begin, size_t end, SampleCounter &counter, std::vector<char> &buffer) const {
+      // The byte before the block tells whether it starts inside a word.
+      const size_t lead = begin > 0 ? 1 : 0;
+      buffer.resize(end - begin + lead);
+      read_at(fd, buffer.data(), buffer.size(), begin - lead);
+      size_t first = lead;
+      if (lead > 0 && !is_delim(buffer.front())) {
+          first = std::find_if(buffer.begin() + 1, buffer.end(), is_delim) - buffer.begin();
+      }
+      if (first == buffer.size()) {
+          return;
+      }
+
+      for (size_t offset = end; !is_delim(buffer.back()) && offset < file_size;) {
+          const size_t size = buffer.size();
+          const size_t piece = std::min(word_piece, file_size - offset);
+          buffer.resize(size + piece);
+          read_at(fd, buffer.data() + size, piece, offset);
+          offset += piece;
+          const auto word_end = std::find_if(buffer.begin() + static_cast<ptrdiff_t>(size), buffer.end(), is_delim);
+          if (word_end != buffer.end()) {
+              buffer.erase(word_end + 1, buffer.end());
+          }
+      }
+
+      const auto count = [&counter](std::string_view word) {
+        count_word(counter, word.data(), word.data() + word.size());
+      };
+      finish(process_chunk(std::span(buffer).subspan(first), counter), count);
+  }
+
+ private:
+  // Bytes read at a time past the end of a block to finish its last word.
+  static constexpr size_t word_piece = 256;
+
+  int fd;
+  size_t file_size;
+};
+
+// Blocks are small enough for many of them to be sampled from any input.
+static size_t get_sample_block_size(size_t file_size) {
+    const auto &config = FreqConfig::instance();
+    const size_t page_size = config.get_disk_page_size();
+    const size_t block_size = std::min(std::max(file_size / 65536, page_size),
+                                       std::max(config.get_read_block_size(), page_size));
+    return block_size / page_size * page_size;
+}
+
+Sample process_file_sampled(const std::string &filename, double fraction, uint64_t seed) {
+    const size_t file_size = get_input_size(filename);
+    const size_t block_size = get_sample_block_size(file_size);
+    Sample sample;
+    sample.blocks = (file_size + block_size - 1) / block_size;
+    const auto sampled = static_cast<size_t>(std::llround(fraction * static_cast<double>(sample.blocks)));
+    sample.sampled = std::min(sample.blocks, std::max<size_t>(sampled, 1));
+    if (sample.sampled == 0) {
+        return sample;
+    }
+
+    // Selection sampling: every block is taken with the probability of its share
+    // of the blocks still to be chosen, so they come in file order.
+    std::vector<size_t> chosen;
+    chosen.reserve(sample.sampled);
+    std::mt19937_64 rng(seed);
+    for (size_t block = 0; chosen.size() < sample.sampled; ++block) {
+        if (std::uniform_int_distribution<size_t>(0, sample.blocks - block - 1)(rng) < sample.sampled - chosen.size()) {
+            chosen.push_back(block);
         }
+    }
 
-        if (ret < 0) {
-            io_error("io_getevents", ret);
+    const size_t threads = std::max<size_t>(FreqConfig::instance().get_processor_count(), 1);
+    std::vector<SampleCounter> per_thread(threads);
+    std::vector<std::vector<char>> buffers(threads);
+    const SampledBlocks blocks(filename, file_size);
+    {
+        auto thread_pool = ThreadPool(threads);
+        std::vector<std::future<void>> tasks;
+        tasks.reserve(chosen.size());
+        for (const size_t block : chosen) {
+            tasks.push_back(thread_pool.enqueue([&, block](size_t thread_index) {
+              per_thread[thread_index].begin_block(block + 1);
+              blocks.count(block * block_size, std::min(file_size, (block + 1) * block_size),
+                           per_thread[thread_index], buffers[thread_index]);
+            }));
+        }
+        for (auto &task : tasks) {
+            task.get();
         }
     }
-    close(fd);
+    sample.words = merge_per_thread(per_thread).take();
+    return sample;
+}
 
-    FreqMap result = process_edges(data, chunk_edges);
+// Selected bytes are handed to the counting threads in batches of about this size.
+static constexpr size_t field_batch_size = size_t{1} << 20;
 
-    for (auto &[key, value] : frequency) {
-        result[key] += value;
+// Records are scanned on the calling thread, which carries the field and
+// quote state from one piece to the next, batches of the selected fields
+// are counted on the threads. A batch ends with a whole field, so no word
+// is cut between batches.
+FreqMap process_file_fields(const std::string &filename, const std::vector<size_t> &fields, char separator) {
+    const auto &config = FreqConfig::instance();
+    const size_t file_size = get_input_size(filename);
+    const size_t threads = std::max<size_t>(config.get_processor_count(), 1);
+    const size_t block_size = std::max<size_t>(config.get_read_block_size(), 1);
+    FieldScanner scanner(fields, separator);
+
+    std::vector<FreqMap> per_thread(threads);
+    {
+        auto thread_pool = ThreadPool(threads);
+        std::deque<std::future<void>> tasks;
+        const auto count = [&](std::string batch) {
+          // Batches in flight bound the memory.
+          if (tasks.size() >= 2 * threads) {
+              tasks.front().get();
+              tasks.pop_front();
+          }
+          tasks.push_back(thread_pool.enqueue([&per_thread, batch = std::move(batch)](size_t thread_index) mutable {
+            FreqMap &words = per_thread[thread_index];
+            finish(process_chunk(std::span(batch.data(), batch.size()), words), [&words](std::string_view word) {
+              count_word(words, word.data(), word.data() + word.size());
+            });
+          }));
+        };
+
+        const int fd = open_file(filename, 0);
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        std::vector<char> buffer(std::min(block_size, file_size));
+        std::string selected;
+        try {
+            for (size_t offset = 0; offset < file_size; offset += buffer.size()) {
+                buffer.resize(std::min(buffer.size(), file_size - offset));
+                read_at(fd, buffer.data(), buffer.size(), offset);
+                for (size_t begin = 0; begin < buffer.size(); begin += field_batch_size) {
+                    const size_t size = std::min(field_batch_size, buffer.size() - begin);
+                    scanner.scan(std::span(buffer.data() + begin, size), selected);
+                    const size_t last_field_end = selected.rfind('\n');
+                    if (selected.size() >= field_batch_size && last_field_end != std::string::npos) {
+                        std::string rest(selected, last_field_end + 1);
+                        selected.resize(last_field_end + 1);
+                        count(std::exchange(selected, std::move(rest)));
+                    }
+                }
+            }
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        count(std::move(selected));
+        for (auto &task : tasks) {
+            task.get();
+        }
     }
+    return merge_per_thread(per_thread);
+}
 
-    return result;
+FreqMap process_file_spilling(const std::string &filename, Spill &spill) {
+    return pipelined_read<SpillingCounter, BufferedSource>(filename, [&] { return SpillingCounter(spill); }).take();
+}
+
+#ifdef ENABLE_PROCESS_MMAPED_FILE
+FreqMap process_mmaped_file(const std::string &filename) {
+    const size_t file_size = get_input_size(filename);
+    const size_t threads = FreqConfig::instance().get_processor_count();
+    Executor workers(threads, 2 * threads);
+    MmapSource source(filename, workers, file_size);
+    return count_input<FreqMap>(source, workers, [] { return FreqMap(); }, file_size,
+                                get_chunk_size(file_size), 2 * threads);
+}
+#endif
+
+#ifdef HAS_LIBAIO
+FreqMap process_file_aio(const std::string &filename) {
+    const auto &config = FreqConfig::instance();
+    Executor workers(config.get_processor_count(), std::max<size_t>(config.get_read_ahead(), 1));
+    AioSource source(filename, workers, config.get_read_ahead());
+    return count_input<FreqMap>(source, workers, [] { return FreqMap(); }, get_input_size(filename),
+                                config.get_read_block_size(), config.get_read_ahead());
 }
 #endif
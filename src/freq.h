@@ -1,10 +1,38 @@
 #ifndef FREQ_SRC_FREQ_H
 #define FREQ_SRC_FREQ_H
 
+#include <span>
 #include <string>
+#include "chunk_edge.h"
+#include "documents.h"
+#include "sampling.h"
 #include "utils.h"
+#include "spill.h"
+#include "vocabulary.h"
+#include "word_tree.h"
 
+// Lowercases chunk in place and counts words lying wholly inside it,
+// words cut by its ends are not counted but returned in its edge.
+ChunkEdge count_chunk(std::span<char> chunk, FreqMap &words);
 FreqMap process_file_blocking_read(const std::string &filename);
+WordTree process_file_blocking_read_tree(const std::string &filename);
+FreqMap process_file_blocking_read_vocab(const std::string &filename, const Vocabulary &vocabulary);
+// Counts words and the documents they occur in: lines of the files, or the files themselves.
+DocumentMap process_files_documents(const std::vector<std::string> &filenames, bool line_documents);
+FreqMap process_file_pipelined(const std::string &filename);
+// Counts bytes [begin, end) of filename, words cut by the ends of the range
+// are not counted but returned in its edge, to be stitched with the neighbours.
+std::pair<FreqMap, OwnedChunkEdge> process_file_range(const std::string &filename, size_t begin, size_t end);
+FreqMap process_file_direct(const std::string &filename);
+// Lossy counting with FreqConfig::get_lossy_error(): rare words are dropped from
+// the tables while counting, counts are at most error * (words counted) short.
+FreqMap process_file_lossy(const std::string &filename);
+// Counts words of a seeded random fraction of the blocks of filename.
+Sample process_file_sampled(const std::string &filename, double fraction, uint64_t seed);
+// Counts words of the selected fields (from 1) of the separated records of filename.
+FreqMap process_file_fields(const std::string &filename, const std::vector<size_t> &fields, char separator);
+// Moves tables outgrowing Spill::table_limit() to spill, returns words left in memory.
+FreqMap process_file_spilling(const std::string &filename, Spill &spill);
 #ifdef ENABLE_PROCESS_MMAPED_FILE
 FreqMap process_mmaped_file(const std::string &filename);
 #endif
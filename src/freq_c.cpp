@@ -0,0 +1,63 @@
+#include <new>
+
+#include "counter.h"
+#include "freq_c.h"
+
+struct freq_counter {
+  FreqCounter counter;
+  // Words returned by the last freq_counter_top().
+  std::vector<std::pair<std::string, size_t>> top;
+};
+
+// Exceptions must not cross into C.
+template<class F>
+static int guarded(F &&f) {
+    try {
+        f();
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+freq_counter *freq_counter_new() {
+    return new(std::nothrow) freq_counter;
+}
+
+void freq_counter_free(freq_counter *counter) {
+    delete counter;
+}
+
+int freq_counter_feed(freq_counter *counter, const char *data, size_t size) {
+    return guarded([&] { counter->counter.feed(std::span(data, size)); });
+}
+
+int freq_counter_finish(freq_counter *counter) {
+    return guarded([&] { counter->counter.finish(); });
+}
+
+int freq_counter_feed_documents(freq_counter *counter, const char *const *documents, const size_t *sizes,
+                                size_t count) {
+    return guarded([&] {
+      std::vector<std::string_view> views;
+      views.reserve(count);
+      for (size_t i = 0; i < count; ++i) {
+          views.emplace_back(documents[i], sizes[i]);
+      }
+      counter->counter.feed_documents(views);
+    });
+}
+
+size_t freq_counter_size(const freq_counter *counter) {
+    return counter->counter.words().size();
+}
+
+size_t freq_counter_top(freq_counter *counter, size_t k, freq_entry *entries) {
+    if (guarded([&] { counter->top = counter->counter.top(k); }) != 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < counter->top.size(); ++i) {
+        entries[i] = {counter->top[i].first.data(), counter->top[i].first.size(), counter->top[i].second};
+    }
+    return counter->top.size();
+}
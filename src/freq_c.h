@@ -0,0 +1,41 @@
+#ifndef FREQ_SRC_FREQ_C_H
+#define FREQ_SRC_FREQ_C_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// C interface of FreqCounter. Functions returning int give 0 on success
+// and -1 when counting failed, e.g. out of memory.
+
+typedef struct freq_counter freq_counter;
+
+typedef struct freq_entry {
+  // Not null terminated, valid until the next call with the counter.
+  const char *word;
+  size_t size;
+  size_t count;
+} freq_entry;
+
+// Returns NULL when out of memory.
+freq_counter *freq_counter_new(void);
+void freq_counter_free(freq_counter *counter);
+
+int freq_counter_feed(freq_counter *counter, const char *data, size_t size);
+int freq_counter_finish(freq_counter *counter);
+// Counts documents[i] of sizes[i] bytes as whole texts, in parallel.
+int freq_counter_feed_documents(freq_counter *counter, const char *const *documents, const size_t *sizes,
+                                size_t count);
+
+// Number of distinct words counted.
+size_t freq_counter_size(const freq_counter *counter);
+// Writes up to k most frequent words to entries and returns their number.
+size_t freq_counter_top(freq_counter *counter, size_t k, freq_entry *entries);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FREQ_SRC_FREQ_C_H
@@ -0,0 +1,149 @@
+#ifndef FREQ_SRC_HUGE_PAGE_ALLOCATOR_H
+#define FREQ_SRC_HUGE_PAGE_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Allocations of at least this size are mapped directly from the kernel.
+constexpr size_t HUGE_PAGE_SIZE = size_t{2} << 20;
+constexpr size_t GIGANTIC_PAGE_SIZE = size_t{1} << 30;
+
+namespace huge_pages {
+
+// Length mapped for an allocation of bytes, whatever pages back it,
+// so deallocate() knows it from bytes alone.
+constexpr size_t mapping_length(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+inline void *map_anonymous(size_t length, int flags) {
+#ifdef __linux__
+    void *ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+#else
+    return nullptr;
+#endif
+}
+
+// Returns zero filled memory backed by 1 GiB pages (for whole numbers
+// of them) or 2 MiB pages if the system has them reserved
+// (MAP_HUGETLB), otherwise by regular pages
+// marked for transparent huge pages. The kernel zeroes pages on first
+// touch, so there is no separate pass over the memory.
+inline void *allocate(size_t bytes) {
+    if (bytes < HUGE_PAGE_SIZE) {
+        return std::calloc(bytes, 1);
+    }
+#ifdef __linux__
+    const size_t length = mapping_length(bytes);
+
+    void *base = nullptr;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    if (length % GIGANTIC_PAGE_SIZE == 0) {
+        base = map_anonymous(length, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT));
+    }
+    if (base == nullptr) {
+        base = map_anonymous(length, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT));
+    }
+#endif
+    if (base == nullptr) {
+        // Over-map by one huge page to align the region for THP.
+        const size_t mapped = length + HUGE_PAGE_SIZE;
+        auto *raw = static_cast<char *>(map_anonymous(mapped, 0));
+        if (raw == nullptr) {
+            return nullptr;
+        }
+        const auto address = reinterpret_cast<uintptr_t>(raw);
+        auto *aligned = reinterpret_cast<char *>((address + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+        if (aligned > raw) {
+            munmap(raw, aligned - raw);
+        }
+        if (raw + mapped > aligned + length) {
+            munmap(aligned + length, raw + mapped - (aligned + length));
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+        base = aligned;
+    }
+    return base;
+#else
+    return std::calloc(bytes, 1);
+#endif
+}
+
+inline void deallocate(void *ptr, size_t bytes) {
+    if (ptr == nullptr) {
+        return;
+    }
+#ifdef __linux__
+    if (bytes >= HUGE_PAGE_SIZE) {
+        munmap(ptr, mapping_length(bytes));
+        return;
+    }
+#endif
+    std::free(ptr);
+}
+
+} // namespace huge_pages
+
+// Standard allocator over huge_pages::allocate. Memory is always zero filled,
+// and elements are default initialized on construction, so a
+// std::vector<char, HugePageAllocator<char>>(n) is never zeroed by hand.
+template<class T>
+struct HugePageAllocator {
+  using value_type = T;
+  // Tells containers that freshly allocated memory reads as zeros.
+  using zero_initialized = std::true_type;
+
+  HugePageAllocator() = default;
+
+  template<class U>
+  HugePageAllocator(const HugePageAllocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+      void *ptr = huge_pages::allocate(n * sizeof(T));
+      if (ptr == nullptr) {
+          throw std::bad_alloc();
+      }
+      return static_cast<T *>(ptr);
+  }
+
+  void deallocate(T *ptr, size_t n) noexcept {
+      huge_pages::deallocate(ptr, n * sizeof(T));
+  }
+
+  template<class U, class... Args>
+  void construct(U *ptr, Args &&... args) {
+      if constexpr (sizeof...(Args) == 0) {
+          ::new(static_cast<void *>(ptr)) U;
+      } else {
+          ::new(static_cast<void *>(ptr)) U(std::forward<Args>(args)...);
+      }
+  }
+
+  template<class U>
+  bool operator==(const HugePageAllocator<U> &) const noexcept {
+      return true;
+  }
+};
+
+template<class Allocator, class = void>
+struct allocator_zeroes_memory : std::false_type {};
+
+template<class Allocator>
+struct allocator_zeroes_memory<Allocator, std::void_t<typename Allocator::zero_initialized>>
+    : Allocator::zero_initialized {};
+
+// Input buffer which is filled by reads, not by the constructor.
+using Buffer = std::vector<char, HugePageAllocator<char>>;
+
+#endif //FREQ_SRC_HUGE_PAGE_ALLOCATOR_H
@@ -1,47 +1,477 @@
+#include <charconv>
+#include <optional>
+#include <limits>
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include "engines.h"
 #include "freq.h"
+#include "report.h"
+#include "shard.h"
+#include "token_filter.h"
 #include "utils.h"
-#include "dummy/freq_dummy.h"
+#include "window.h"
 
-typedef FreqMap(*ProcessMethodType)(const std::string &filename);
+struct Options {
+  std::string input_file;
+  std::string output_file;
+  // Count words in WordTree (adaptive radix tree) instead of FreqMap.
+  bool tree_backend = false;
+  // Order output by word instead of by descending frequency.
+  bool alphabetical = false;
+  // Report only words starting with prefix.
+  std::string prefix;
+  // Count only words listed in this file.
+  std::string vocabulary_file;
+  // Drop stopwords listed in this file and words out of [min_length, max_length] before counting.
+  std::string stopwords_file;
+  size_t min_length = 0;
+  size_t max_length = std::numeric_limits<size_t>::max();
+  // Count with this engine instead of the one chosen by choose_engine().
+  const Engine *engine = nullptr;
+  // Spill words to disk to keep tables and buffers within this many bytes, 0 for no limit.
+  size_t max_memory = 0;
+  // Count only shard shard_index of shard_count and write its partial table to output_file.
+  size_t shard_index = 0;
+  size_t shard_count = 0;
+  // Count in this many worker processes, 0 to count in this one.
+  size_t workers = 0;
+  // Positional arguments are partial tables to merge, followed by output_file.
+  bool merge = false;
+  std::vector<std::string> partial_files;
+  // Tuning options passed on to worker processes.
+  std::vector<std::string> worker_arguments;
+  // Count documents every word occurs in too: lines, or whole input files.
+  // Positional arguments are input files, followed by output_file.
+  bool document_frequency = false;
+  bool line_documents = true;
+  std::vector<std::string> input_files;
+  // Estimate counts from this fraction of the input's blocks, chosen by seed, 0 to count all of it.
+  double sample_fraction = 0;
+  uint64_t seed = 0;
+  // Report the top words of every window of window seconds ending each window_step seconds
+  // of a log with leading timestamps, 0 to count the whole input.
+  int64_t window = 0;
+  int64_t window_step = 0;
+  size_t top = 10;
+  // Count only words of these fields (from 1) of records separated by separator.
+  std::vector<size_t> fields;
+  char separator = '\t';
+};
 
-ProcessMethodType get_method() {
+// Accepts K, M and G suffixes (powers of 1024).
+static bool parse_size(std::string_view value, size_t &result) {
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc()) {
+        return false;
+    }
+    const std::string_view suffix(ptr, value.data() + value.size() - ptr);
+    const size_t shift = suffix.empty() ? 0 : suffix == "K" ? 10 : suffix == "M" ? 20 : suffix == "G" ? 30 : 64;
+    if (shift == 64 || (shift > 0 && result > (std::numeric_limits<size_t>::max() >> shift))) {
+        return false;
+    }
+    result <<= shift;
+    return true;
+}
+
+// Parses "i/N" with i < N.
+static bool parse_shard(std::string_view value, size_t &index, size_t &count) {
+    const auto slash = value.find('/');
+    if (slash == std::string_view::npos) {
+        return false;
+    }
+    const auto index_part = value.substr(0, slash);
+    const auto count_part = value.substr(slash + 1);
+    const auto [index_end, index_ec] = std::from_chars(index_part.data(), index_part.data() + index_part.size(), index);
+    const auto [count_end, count_ec] = std::from_chars(count_part.data(), count_part.data() + count_part.size(), count);
+    return index_ec == std::errc() && index_end == index_part.data() + index_part.size()
+        && count_ec == std::errc() && count_end == count_part.data() + count_part.size() && index < count;
+}
+
+// Parses a number in (0, 1).
+static bool parse_fraction(std::string_view value, double &result) {
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    return ec == std::errc() && ptr == value.data() + value.size() && result > 0 && result < 1;
+}
+
+// Parses seconds with an optional s, m, h or d suffix.
+static bool parse_duration(std::string_view value, int64_t &result) {
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc() || result <= 0) {
+        return false;
+    }
+    const std::string_view suffix(ptr, value.data() + value.size() - ptr);
+    const int64_t unit = suffix.empty() || suffix == "s" ? 1 : suffix == "m" ? 60 : suffix == "h" ? 3600
+                         : suffix == "d" ? 86400 : 0;
+    if (unit == 0 || result > std::numeric_limits<int64_t>::max() / unit) {
+        return false;
+    }
+    result *= unit;
+    return true;
+}
+
+// Parses "N[,M...]" of numbers from 1.
+static bool parse_fields(std::string_view value, std::vector<size_t> &fields) {
+    fields.clear();
+    for (size_t begin = 0; begin <= value.size();) {
+        const size_t end = std::min(value.find(',', begin), value.size());
+        size_t field;
+        const auto [ptr, ec] = std::from_chars(value.data() + begin, value.data() + end, field);
+        if (ec != std::errc() || ptr != value.data() + end || field == 0) {
+            return false;
+        }
+        fields.push_back(field);
+        begin = end + 1;
+    }
+    return !fields.empty();
+}
+
+// Parses a single character, "\t" standing for a tab.
+static bool parse_separator(std::string_view value, char &separator) {
+    if (value == "\\t") {
+        separator = '\t';
+        return true;
+    }
+    if (value.size() != 1 || value[0] == '\n' || value[0] == '"') {
+        return false;
+    }
+    separator = value[0];
+    return true;
+}
+
+static bool parse_options(int argc, char *argv[], Options &options) {
     auto &config = FreqConfig::instance();
 
-    if (config.get_processor_count() > 1) {
-        return process_file_blocking_read;
+    std::vector<std::string_view> positional;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg(argv[i]);
+        if (!arg.starts_with("--")) {
+            positional.push_back(arg);
+            continue;
+        }
+
+        const auto eq = arg.find('=');
+        const auto name = arg.substr(0, eq);
+        const auto value = eq == std::string_view::npos ? std::string_view() : arg.substr(eq + 1);
+
+        if (name == "--backend" && (value == "hash" || value == "tree")) {
+            options.tree_backend = value == "tree";
+        } else if (name == "--order" && (value == "frequency" || value == "alpha")) {
+            options.alphabetical = value == "alpha";
+        } else if (name == "--prefix" && eq != std::string_view::npos) {
+            options.prefix = value;
+        } else if (name == "--vocab" && !value.empty()) {
+            options.vocabulary_file = value;
+        } else if (name == "--stopwords" && !value.empty()) {
+            options.stopwords_file = value;
+            options.worker_arguments.emplace_back(arg);
+        } else if (size_t length; name == "--min-length" && parse_size(value, length)) {
+            options.min_length = length;
+            options.worker_arguments.emplace_back(arg);
+        } else if (size_t length; name == "--max-length" && parse_size(value, length)) {
+            options.max_length = length;
+            options.worker_arguments.emplace_back(arg);
+        } else if (size_t count; name == "--min-count" && parse_size(value, count)) {
+            config.set_min_count(count);
+        } else if (name == "--sample" && parse_fraction(value, options.sample_fraction)) {
+        } else if (name == "--seed" && parse_size(value, options.seed)) {
+        } else if (name == "--window" && parse_duration(value, options.window)) {
+        } else if (name == "--step" && parse_duration(value, options.window_step)) {
+        } else if (name == "--top" && parse_size(value, options.top)) {
+        } else if (name == "--field" && parse_fields(value, options.fields)) {
+        } else if (name == "--sep" && parse_separator(value, options.separator)) {
+        } else if (double error; name == "--lossy" && parse_fraction(value, error)) {
+            config.set_lossy_error(error);
+            options.worker_arguments.emplace_back(arg);
+        } else if (size_t size; name == "--insert-batch" && parse_size(value, size)) {
+            config.set_insert_batch_size(size);
+            options.worker_arguments.emplace_back(arg);
+        } else if (name == "--engine" && (value == "auto" || find_engine(value) != nullptr)) {
+            options.engine = find_engine(value);
+        } else if (size_t bytes; name == "--max-memory" && parse_size(value, bytes) && bytes > 0) {
+            options.max_memory = bytes;
+        } else if (size_t blocks; name == "--read-ahead" && parse_size(value, blocks) && blocks > 0) {
+            config.set_read_ahead(blocks);
+            options.worker_arguments.emplace_back(arg);
+        } else if (size_t count; name == "--readers" && parse_size(value, count) && count > 0) {
+            config.set_reader_count(count);
+            options.worker_arguments.emplace_back(arg);
+        } else if (size_t size; name == "--block-size" && parse_size(value, size) && size > 0) {
+            config.set_read_block_size(size);
+            options.worker_arguments.emplace_back(arg);
+        } else if (size_t threads; name == "--threads" && parse_size(value, threads) && threads > 0) {
+            config.set_processor_count(threads);
+        } else if (name == "--shard" && parse_shard(value, options.shard_index, options.shard_count)) {
+        } else if (size_t count; name == "--shards" && parse_size(value, count) && count > 0) {
+            options.workers = count;
+        } else if (name == "--merge" && eq == std::string_view::npos) {
+            options.merge = true;
+        } else if (name == "--df" && (eq == std::string_view::npos || value == "line" || value == "file")) {
+            options.document_frequency = true;
+            options.line_documents = value != "file";
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (config.get_lossy_error() > 0 && (options.document_frequency || options.tree_backend
+                                         || options.max_memory > 0 || !options.vocabulary_file.empty())) {
+        std::cerr << "--lossy counts with the hash backend only" << std::endl;
+        return false;
+    }
+    if (options.sample_fraction > 0 && (options.document_frequency || options.merge || options.shard_count > 0
+                                        || options.workers > 0 || options.tree_backend || options.max_memory > 0
+                                        || !options.vocabulary_file.empty() || config.get_lossy_error() > 0)) {
+        std::cerr << "--sample counts in memory with the hash backend only" << std::endl;
+        return false;
+    }
+    if (options.window > 0) {
+        if (options.window_step == 0) {
+            // 60 buckets a window when they can last whole seconds.
+            options.window_step = options.window % 60 == 0 ? options.window / 60 : 1;
+        }
+        if (options.window % options.window_step != 0) {
+            std::cerr << "--window must be a multiple of --step" << std::endl;
+            return false;
+        }
+        if (options.document_frequency || options.merge || options.shard_count > 0 || options.workers > 0
+            || options.tree_backend || options.max_memory > 0 || !options.vocabulary_file.empty()
+            || config.get_lossy_error() > 0 || options.sample_fraction > 0) {
+            std::cerr << "--window counts in memory with the hash backend only" << std::endl;
+            return false;
+        }
+    }
+    if (!options.fields.empty() && (options.document_frequency || options.merge || options.shard_count > 0
+                                    || options.workers > 0 || options.tree_backend || options.max_memory > 0
+                                    || !options.vocabulary_file.empty() || config.get_lossy_error() > 0
+                                    || options.sample_fraction > 0 || options.window > 0)) {
+        std::cerr << "--field counts in memory with the hash backend only" << std::endl;
+        return false;
+    }
+    if (options.document_frequency) {
+        if (options.merge || options.shard_count > 0 || options.workers > 0 || options.tree_backend
+            || options.max_memory > 0 || !options.vocabulary_file.empty()) {
+            std::cerr << "--df counts in memory with the hash backend only" << std::endl;
+            return false;
+        }
+        if (positional.size() < 2) {
+            return false;
+        }
+        options.input_files.assign(positional.begin(), positional.end() - 1);
+        options.output_file = positional.back();
+        return true;
+    }
+    if (options.merge) {
+        if (positional.size() < 2) {
+            return false;
+        }
+        options.partial_files.assign(positional.begin(), positional.end() - 1);
+        options.output_file = positional.back();
+        return true;
+    }
+    if (positional.size() != 2) {
+        return false;
+    }
+    options.input_file = positional[0];
+    options.output_file = positional[1];
+    return true;
+}
+
+static void sort_by_frequency(std::vector<std::pair<std::string, size_t>> &word_freq_pairs) {
+    std::sort(word_freq_pairs.begin(), word_freq_pairs.end(), report_order(false));
+}
+
+// Words are copied out only when they are reported.
+static std::vector<std::pair<std::string, size_t>> collect(const FreqMap &data, const Options &options) {
+    const size_t min_count = FreqConfig::instance().get_min_count();
+    std::vector<std::pair<std::string, size_t>> word_freq_pairs;
+    data.for_each([&](std::string_view word, size_t count, uint64_t) {
+      if (count >= min_count && word.starts_with(options.prefix)) {
+          word_freq_pairs.emplace_back(word, count);
+      }
+    });
+    if (options.alphabetical) {
+        std::sort(word_freq_pairs.begin(), word_freq_pairs.end());
+    }
+    return word_freq_pairs;
+}
+
+// Entries made of the table values of the reported words, those counted at
+// least min_count times and starting with the prefix, in report order.
+template<class Entry, class Map, class MakeEntry>
+static std::vector<std::pair<std::string, Entry>> report_entries(const Map &words, const Options &options,
+                                                                 MakeEntry entry) {
+    const size_t min_count = FreqConfig::instance().get_min_count();
+    std::vector<std::pair<std::string, Entry>> entries;
+    words.for_each([&](std::string_view word, const auto &value, uint64_t) {
+      const Entry made = entry(value);
+      if (made.count >= min_count && word.starts_with(options.prefix)) {
+          entries.emplace_back(word, made);
+      }
+    });
+    std::sort(entries.begin(), entries.end(), report_order(options.alphabetical, [](const auto &entry) {
+      return std::pair<std::string_view, size_t>(entry.first, entry.second.count);
+    }));
+    return entries;
+}
+
+// Writes "count documents word" lines, ordered as the other reports.
+static void write_document_frequencies(const DocumentMap &data, const Options &options, std::ostream &output) {
+    const auto entries = report_entries<DocumentCount>(data, options, [](const DocumentCount &entry) {
+      return entry;
+    });
+    for (const auto &[word, entry] : entries) {
+        output << entry.count << ' ' << entry.documents << ' ' << word << '\n';
     }
-#ifdef HAS_LIBAIO
-    return process_file_aio;
-#else
-    return process_file_dummy;
-#endif
+}
+
+// Writes "count low high word" lines: counts estimated from the sample and their 95% confidence intervals.
+static void write_sample_estimates(const Sample &sample, const Options &options, std::ostream &output) {
+    const auto entries = report_entries<Sample::Estimate>(sample.words, options, [&](const SampleCount &entry) {
+      return sample.estimate(entry);
+    });
+    for (const auto &[word, estimate] : entries) {
+        output << estimate.count << ' ' << estimate.low << ' ' << estimate.high << ' ' << word << '\n';
+    }
+}
+
+// Writes "end count word" lines, the top words of every window by descending
+// count, as windows end, and flushes them for readers following the output.
+static void write_windows(const Options &options, std::ostream &output) {
+    WindowCounter counter(options.window, options.window_step, options.top,
+                          [&](int64_t end, const std::vector<std::pair<std::string, size_t>> &top) {
+                            const std::string time = format_timestamp(end);
+                            for (const auto &[word, count] : top) {
+                                output << time << ' ' << count << ' ' << word << '\n';
+                            }
+                            output.flush();
+                          });
+    count_log(options.input_file, counter);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " [input_file] [output_file]" << std::endl;
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--backend=hash|tree] [--order=frequency|alpha] [--prefix=STR] [--vocab=FILE]"
+                  << " [--stopwords=FILE] [--min-length=N] [--max-length=N] [--min-count=N] [--lossy=E]"
+                  << " [--sample=P] [--seed=N] [--window=DURATION [--step=DURATION] [--top=K]]"
+                  << " [--field=N[,M...] [--sep=C]]"
+                  << " [--insert-batch=N] [--engine=auto|NAME] [--max-memory=N]"
+                  << " [--read-ahead=N] [--readers=N] [--block-size=N] [--threads=N]"
+                  << " [--shard=I/N | --shards=N] [input_file] [output_file]" << std::endl
+                  << "       " << argv[0] << " --merge [--order=frequency|alpha] [--prefix=STR]"
+                  << " partial_file... [output_file]" << std::endl
+                  << "       " << argv[0] << " --df[=line|file] [--order=frequency|alpha] [--prefix=STR]"
+                  << " input_file... [output_file]" << std::endl;
         return 1;
     }
 
-    const char *input_file = argv[1];
-    const char *output_file = argv[2];
+    auto &config = FreqConfig::instance();
 
-    const auto &data = get_method()(input_file);
+    std::optional<TokenFilter> filter;
+    if (!options.stopwords_file.empty() || options.min_length > 0
+        || options.max_length != std::numeric_limits<size_t>::max()) {
+        std::optional<Vocabulary> stopwords;
+        if (!options.stopwords_file.empty()) {
+            stopwords = Vocabulary::load(options.stopwords_file);
+        }
+        filter.emplace(options.min_length, options.max_length, std::move(stopwords));
+        config.set_token_filter(&*filter);
+    }
 
-    std::vector<std::pair<std::string, size_t>> word_freq_pairs(
-        std::move_iterator(data.begin()),
-        std::move_iterator(data.end())
-    );
-    std::sort(word_freq_pairs.begin(), word_freq_pairs.end(), [](const auto &p1, const auto &p2) {
-      auto &[word1, freq1] = p1;
-      auto &[word2, freq2] = p2;
-      return std::tie(freq2, word1) < std::tie(freq1, word2);
-    });
+    if (options.shard_count > 0) {
+        write_partial(options.input_file, options.shard_index, options.shard_count, options.output_file);
+        return 0;
+    }
 
     std::ofstream output;
-    output.open(output_file);
+    output.open(options.output_file);
+
+    if (options.window > 0) {
+        write_windows(options, output);
+        output.close();
+        return 0;
+    }
+
+    if (options.sample_fraction > 0) {
+        write_sample_estimates(process_file_sampled(options.input_file, options.sample_fraction, options.seed),
+                               options, output);
+        output.close();
+        return 0;
+    }
+
+    if (options.document_frequency) {
+        write_document_frequencies(process_files_documents(options.input_files, options.line_documents),
+                                   options, output);
+        output.close();
+        return 0;
+    }
+
+    // Shards are counted and merged in FreqMap.
+    const bool sharded = options.merge || options.workers > 0;
+    if (!sharded && options.tree_backend && options.alphabetical && options.vocabulary_file.empty()) {
+        // Tree is already ordered, words are written as they are visited.
+        const auto &data = process_file_blocking_read_tree(options.input_file);
+        data.for_each([&](std::string_view word, size_t count) {
+          if (count >= config.get_min_count()) {
+              output << count << ' ' << word << '\n';
+          }
+        }, options.prefix);
+        output.close();
+        return 0;
+    }
+
+    if (!sharded && options.max_memory > 0 && !options.tree_backend && options.vocabulary_file.empty()) {
+        // Words come ordered, straight from the spill files.
+        count_with_spill(options.input_file, options.max_memory, options.alphabetical,
+                         [&](std::string_view word, size_t count) {
+                           if (word.starts_with(options.prefix)) {
+                               output << count << ' ' << word << '\n';
+                           }
+                         });
+        output.close();
+        return 0;
+    }
+
+    std::vector<std::pair<std::string, size_t>> word_freq_pairs;
+    if (options.merge) {
+        word_freq_pairs = collect(merge_partials(options.partial_files), options);
+    } else if (options.workers > 0) {
+        // Workers share the cores.
+        auto arguments = options.worker_arguments;
+        arguments.push_back("--threads=" + std::to_string(std::max<size_t>(config.get_processor_count() / options.workers, 1)));
+        const std::string executable = std::filesystem::exists("/proc/self/exe")
+                                       ? std::filesystem::read_symlink("/proc/self/exe").string() : argv[0];
+        word_freq_pairs = collect(count_with_shards(options.input_file, options.workers, executable, arguments), options);
+    } else if (!options.fields.empty()) {
+        word_freq_pairs = collect(process_file_fields(options.input_file, options.fields, options.separator), options);
+    } else if (!options.vocabulary_file.empty()) {
+        const auto vocabulary = Vocabulary::load(options.vocabulary_file);
+        word_freq_pairs = collect(process_file_blocking_read_vocab(options.input_file, vocabulary), options);
+    } else if (options.tree_backend) {
+        const auto &data = process_file_blocking_read_tree(options.input_file);
+        word_freq_pairs.reserve(data.size());
+        data.for_each([&](std::string_view word, size_t count) {
+          if (count >= config.get_min_count()) {
+              word_freq_pairs.emplace_back(word, count);
+          }
+        }, options.prefix);
+    } else {
+        auto choice = EngineChoice{options.engine, config.get_processor_count()};
+        if (choice.engine == nullptr) {
+            choice = choose_engine(options.input_file);
+        }
+        config.set_processor_count(choice.threads);
+        const auto method = config.get_lossy_error() > 0 ? process_file_lossy : choice.engine->process;
+        word_freq_pairs = collect(method(options.input_file), options);
+    }
+
+    if (!options.alphabetical) {
+        sort_by_frequency(word_freq_pairs);
+    }
+
     for (const auto &[word, count] : word_freq_pairs) {
         output << count << ' ' << word << '\n';
     }
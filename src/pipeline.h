@@ -0,0 +1,237 @@
+#ifndef FREQ_SRC_PIPELINE_H
+#define FREQ_SRC_PIPELINE_H
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../libs/ring_queue.h"
+
+// Building blocks of the counting pipeline: every block of the input is
+// a coroutine which awaits a buffer, then its data from an I/O source,
+// then a counting thread. Sources and stages do not block threads of
+// one another, whatever mix of threads and kernel queues they run on.
+
+// Resumes coroutines on its own threads, which take them from a lock-free
+// ring. Coroutines of a pipeline wait for at most one executor at a time,
+// so a ring as large as the blocks in flight never fills up.
+class Executor {
+ public:
+  // capacity is the most coroutines waiting for a thread at once.
+  Executor(size_t threads, size_t capacity) : queue(capacity + threads) {
+      workers.reserve(threads);
+      for (size_t i = 0; i < threads; ++i) {
+          workers.emplace_back([this, i] {
+            current = this;
+            current_index = i;
+            for (Work work = queue.pop(); work.call != nullptr; work = queue.pop()) {
+                work.call(work.context);
+            }
+          });
+      }
+  }
+
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  ~Executor() {
+      for (size_t i = 0; i < workers.size(); ++i) {
+          queue.push(Work{});
+      }
+      for (auto &worker : workers) {
+          worker.join();
+      }
+  }
+
+  [[nodiscard]] size_t size() const {
+      return workers.size();
+  }
+
+  // Resumes h on one of the threads.
+  void post(std::coroutine_handle<> h) {
+      queue.push(Work{[](void *context) { std::coroutine_handle<>::from_address(context).resume(); }, h.address()});
+  }
+
+  // Awaitable of f() called on one of the threads, the coroutine continues
+  // there. Runs at once if the coroutine is already on one of them.
+  template<class F>
+  auto run(F f) {
+      using Result = std::invoke_result_t<F>;
+
+      struct Awaiter {
+        Executor &executor;
+        F f;
+        std::optional<Result> result;
+        std::exception_ptr error;
+        std::coroutine_handle<> handle;
+
+        void call() {
+            try {
+                result.emplace(f());
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        bool await_ready() {
+            if (current == &executor) {
+                call();
+                return true;
+            }
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            executor.queue.push(Work{[](void *context) {
+              auto &awaiter = *static_cast<Awaiter *>(context);
+              awaiter.call();
+              awaiter.handle.resume();
+            }, this});
+        }
+
+        Result await_resume() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return std::move(*result);
+        }
+      };
+      return Awaiter{*this, std::move(f), std::nullopt, nullptr, nullptr};
+  }
+
+  // Awaitable moving the coroutine to one of the threads, gives the index of the thread.
+  auto schedule() {
+      struct Awaiter {
+        Executor &executor;
+
+        [[nodiscard]] bool await_ready() const {
+            return current == &executor;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            executor.post(h);
+        }
+
+        [[nodiscard]] size_t await_resume() const {
+            return current_index;
+        }
+      };
+      return Awaiter{*this};
+  }
+
+ private:
+  // Null call stops a thread.
+  struct Work {
+    void (*call)(void *context) = nullptr;
+    void *context = nullptr;
+  };
+
+  // Executor and index of the calling thread.
+  static inline thread_local const Executor *current = nullptr;
+  static inline thread_local size_t current_index = 0;
+
+  MpmcQueue<Work> queue;
+  std::vector<std::thread> workers;
+};
+
+// Coroutines spawned into a TaskGroup start at once and are destroyed
+// when they complete, wait() blocks until all of them have.
+class TaskGroup {
+ public:
+  struct Task {
+    struct promise_type {
+      TaskGroup *group = nullptr;
+
+      Task get_return_object() {
+          return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+
+      std::suspend_always initial_suspend() noexcept {
+          return {};
+      }
+
+      // The frame is gone before the group learns of the completion.
+      auto final_suspend() noexcept {
+          struct Awaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                TaskGroup *group = h.promise().group;
+                h.destroy();
+                group->complete();
+            }
+
+            void await_resume() noexcept {}
+          };
+          return Awaiter{};
+      }
+
+      void return_void() {}
+
+      void unhandled_exception() {
+          group->fail(std::current_exception());
+      }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+  };
+
+  TaskGroup() = default;
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void spawn(Task task) {
+      {
+          std::lock_guard lock(mutex);
+          ++running;
+      }
+      task.handle.promise().group = this;
+      task.handle.resume();
+  }
+
+  // True once a task has thrown, tasks yet to start may skip their work.
+  [[nodiscard]] bool failed() const {
+      std::lock_guard lock(mutex);
+      return error != nullptr;
+  }
+
+  // Waits for all tasks, rethrows the first exception of any of them.
+  void wait() {
+      std::unique_lock lock(mutex);
+      done.wait(lock, [this] { return running == 0; });
+      if (error) {
+          std::rethrow_exception(error);
+      }
+  }
+
+ private:
+  void fail(std::exception_ptr exception) {
+      std::lock_guard lock(mutex);
+      if (!error) {
+          error = std::move(exception);
+      }
+  }
+
+  void complete() {
+      std::lock_guard lock(mutex);
+      if (--running == 0) {
+          done.notify_all();
+      }
+  }
+
+  mutable std::mutex mutex;
+  std::condition_variable done;
+  size_t running = 0;
+  std::exception_ptr error;
+};
+
+#endif //FREQ_SRC_PIPELINE_H
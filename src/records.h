@@ -0,0 +1,45 @@
+#ifndef FREQ_SRC_RECORDS_H
+#define FREQ_SRC_RECORDS_H
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+
+// Word counts on disk, in spill files and shard partials:
+// hash, count, word length and word bytes.
+struct Record {
+  uint64_t hash;
+  size_t count;
+  std::string word;
+};
+
+// Record data is written in pieces of about this size.
+inline constexpr size_t flush_size = size_t{64} << 10;
+
+inline void append_record(std::string &buffer, std::string_view word, size_t count, uint64_t hash) {
+    const auto length = static_cast<uint32_t>(word.size());
+    const size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(hash) + sizeof(count) + sizeof(length) + word.size());
+    char *out = buffer.data() + offset;
+    std::memcpy(out, &hash, sizeof(hash));
+    std::memcpy(out + sizeof(hash), &count, sizeof(count));
+    std::memcpy(out + sizeof(hash) + sizeof(count), &length, sizeof(length));
+    std::memcpy(out + sizeof(hash) + sizeof(count) + sizeof(length), word.data(), word.size());
+}
+
+inline bool read_record(std::istream &in, Record &record) {
+    uint32_t length;
+    in.read(reinterpret_cast<char *>(&record.hash), sizeof(record.hash));
+    in.read(reinterpret_cast<char *>(&record.count), sizeof(record.count));
+    in.read(reinterpret_cast<char *>(&length), sizeof(length));
+    if (!in) {
+        return false;
+    }
+    record.word.resize(length);
+    in.read(record.word.data(), length);
+    return static_cast<bool>(in);
+}
+
+#endif //FREQ_SRC_RECORDS_H
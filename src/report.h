@@ -0,0 +1,29 @@
+#ifndef FREQ_SRC_REPORT_H
+#define FREQ_SRC_REPORT_H
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+// Order of reports: alphabetical, or by descending count and then
+// alphabetical. key gives the word and the count of an entry.
+template<class Key>
+auto report_order(bool alphabetical, Key key) {
+    return [alphabetical, key](const auto &lhs, const auto &rhs) {
+      const auto [lhs_word, lhs_count] = key(lhs);
+      const auto [rhs_word, rhs_count] = key(rhs);
+      if (alphabetical || lhs_count == rhs_count) {
+          return lhs_word < rhs_word;
+      }
+      return lhs_count > rhs_count;
+    };
+}
+
+// Report order of (word, count) pairs.
+inline auto report_order(bool alphabetical) {
+    return report_order(alphabetical, [](const auto &entry) {
+      return std::pair<std::string_view, size_t>(entry.first, entry.second);
+    });
+}
+
+#endif //FREQ_SRC_REPORT_H
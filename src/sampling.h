@@ -0,0 +1,110 @@
+#ifndef FREQ_SRC_SAMPLING_H
+#define FREQ_SRC_SAMPLING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include "word_map.h"
+
+// Table entry of a word in sampled blocks: occurrences, and the sum of
+// squares of its counts per block, for the variance between blocks.
+// Blocks are counted one after another, so the count in the current
+// block is kept apart until a word of another block comes.
+struct SampleCount {
+  size_t count = 0;
+  // Sum of squares of the blocks before the current one.
+  size_t squares = 0;
+  size_t block_count = 0;
+  // 0 before the word is counted in any block.
+  uint64_t last_block = 0;
+
+  void add(uint64_t block) {
+      if (block != last_block) {
+          squares += block_count * block_count;
+          block_count = 0;
+          last_block = block;
+      }
+      ++count;
+      ++block_count;
+  }
+
+  [[nodiscard]] size_t sum_of_squares() const {
+      return squares + block_count * block_count;
+  }
+
+  // Tables merged never count parts of one block.
+  SampleCount &operator+=(const SampleCount &other) {
+      count += other.count;
+      squares = sum_of_squares() + other.sum_of_squares();
+      block_count = 0;
+      last_block = 0;
+      return *this;
+  }
+};
+
+using SampleMap = BasicWordMap<HugePageAllocator<char>, SampleCount>;
+
+// Per-thread counter of sampled blocks, words are counted in the block
+// set by begin_block() with ids from 1.
+class SampleCounter {
+ public:
+  void reserve(size_t n) {
+      words.reserve(n);
+  }
+
+  void begin_block(uint64_t id) {
+      block = id;
+  }
+
+  void add(std::string_view word) {
+      words[word].add(block);
+  }
+
+  void merge(SampleCounter &&other) {
+      words.merge(other.words);
+  }
+
+  SampleMap take() {
+      return std::move(words);
+  }
+
+ private:
+  SampleMap words;
+  uint64_t block = 1;
+};
+
+// Words of sampled blocks out of all blocks of an input.
+struct Sample {
+  SampleMap words;
+  size_t blocks = 0;
+  size_t sampled = 0;
+
+  struct Estimate {
+    size_t count;
+    size_t low;
+    size_t high;
+  };
+
+  // Count of a word in the whole input scaled up from the sample, with
+  // a 95% confidence interval from the variance of its counts between
+  // the sampled blocks, blocks without the word counting 0. The input
+  // holds at least the occurrences seen, which bounds the interval.
+  [[nodiscard]] Estimate estimate(const SampleCount &entry) const {
+      const auto b = static_cast<double>(sampled);
+      const auto total = static_cast<double>(blocks);
+      const auto sum = static_cast<double>(entry.count);
+      const double variance = sampled > 1
+                              ? (static_cast<double>(entry.sum_of_squares()) - sum * sum / b) / (b - 1) : 0;
+      const double spread = 1.96 * std::sqrt(std::max(total * total * (1 - b / total) * variance / b, 0.0));
+      const double count = sum * total / b;
+      return {
+          static_cast<size_t>(std::llround(count)),
+          static_cast<size_t>(std::llround(std::max(count - spread, sum))),
+          static_cast<size_t>(std::llround(count + spread)),
+      };
+  }
+};
+
+#endif //FREQ_SRC_SAMPLING_H
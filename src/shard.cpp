@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spawn.h>
+#include <stdexcept>
+#include <sys/wait.h>
+
+#include "freq.h"
+#include "records.h"
+#include "shard.h"
+#include "token_filter.h"
+
+extern char **environ;
+
+// Partials start with the magic, shard index, shard count, input size,
+// edge of the shard and the number of records which follow it.
+static constexpr char partial_magic[8] = {'F', 'R', 'E', 'Q', 'P', 'R', 'T', '1'};
+
+struct Partial {
+  uint64_t index = 0;
+  uint64_t count = 0;
+  uint64_t input_size = 0;
+  OwnedChunkEdge edge;
+  uint64_t records = 0;
+};
+
+static void append_value(std::string &buffer, uint64_t value) {
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void append_string(std::string &buffer, std::string_view value) {
+    append_value(buffer, value.size());
+    buffer += value;
+}
+
+static bool read_value(std::istream &in, uint64_t &value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+static bool read_string(std::istream &in, std::string &value) {
+    uint64_t size;
+    if (!read_value(in, size)) {
+        return false;
+    }
+    value.resize(size);
+    return static_cast<bool>(in.read(value.data(), static_cast<std::streamsize>(size)));
+}
+
+static Partial read_header(std::istream &in, const std::string &path) {
+    char magic[sizeof(partial_magic)];
+    Partial partial;
+    uint64_t whole_word;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), partial_magic)
+        || !read_value(in, partial.index) || !read_value(in, partial.count) || !read_value(in, partial.input_size)
+        || !read_value(in, whole_word) || !read_string(in, partial.edge.left) || !read_string(in, partial.edge.right)
+        || !read_value(in, partial.records)) {
+        throw std::runtime_error("not a partial table: " + path);
+    }
+    partial.edge.whole_word = whole_word != 0;
+    return partial;
+}
+
+std::pair<size_t, size_t> shard_range(size_t file_size, size_t index, size_t count) {
+    const size_t share = file_size / count;
+    const size_t rest = file_size % count;
+    const size_t begin = index * share + std::min(index, rest);
+    return {begin, begin + share + (index < rest ? 1 : 0)};
+}
+
+void write_partial(const std::string &filename, size_t index, size_t count, const std::string &path) {
+    if (count == 0 || index >= count) {
+        throw std::invalid_argument("invalid shard " + std::to_string(index) + "/" + std::to_string(count));
+    }
+    const size_t input_size = std::min<size_t>(std::filesystem::file_size(filename),
+                                               FreqConfig::instance().get_input_limit());
+    const auto [begin, end] = shard_range(input_size, index, count);
+    const auto [words, edge] = process_file_range(filename, begin, end);
+
+    std::string buffer(partial_magic, sizeof(partial_magic));
+    append_value(buffer, index);
+    append_value(buffer, count);
+    append_value(buffer, input_size);
+    append_value(buffer, edge.whole_word);
+    append_string(buffer, edge.left);
+    append_string(buffer, edge.right);
+    append_value(buffer, words.size());
+
+    std::ofstream file(path, std::ofstream::binary | std::ofstream::trunc);
+    words.for_each([&](std::string_view word, size_t word_count, uint64_t hash) {
+      append_record(buffer, word, word_count, hash);
+      if (buffer.size() >= flush_size) {
+          file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+          buffer.clear();
+      }
+    });
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    file.close();
+    if (!file) {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+FreqMap merge_partials(const std::vector<std::string> &paths) {
+    if (paths.empty()) {
+        throw std::invalid_argument("no partial tables to merge");
+    }
+
+    FreqMap result;
+    std::vector<OwnedChunkEdge> edges;
+    std::vector<bool> seen;
+    uint64_t input_size = 0;
+    for (const auto &path : paths) {
+        std::ifstream file(path, std::ifstream::binary);
+        if (!file) {
+            throw std::runtime_error("cannot open " + path);
+        }
+        auto partial = read_header(file, path);
+        if (edges.empty()) {
+            edges.resize(partial.count);
+            seen.resize(partial.count);
+            input_size = partial.input_size;
+            result.reserve(partial.records);
+        }
+        if (partial.count != edges.size() || partial.input_size != input_size || partial.index >= partial.count) {
+            throw std::runtime_error("partial table of another input: " + path);
+        }
+        if (seen[partial.index]) {
+            throw std::runtime_error("shard " + std::to_string(partial.index) + " given twice: " + path);
+        }
+        seen[partial.index] = true;
+        edges[partial.index] = std::move(partial.edge);
+
+        Record record;
+        for (uint64_t i = 0; i < partial.records; ++i) {
+            if (!read_record(file, record)) {
+                throw std::runtime_error("truncated partial table: " + path);
+            }
+            result.find_or_insert(record.word, record.hash) += record.count;
+        }
+    }
+    if (const auto missing = std::find(seen.begin(), seen.end(), false); missing != seen.end()) {
+        throw std::runtime_error("shard " + std::to_string(missing - seen.begin()) + " is missing");
+    }
+
+    std::string edge_storage;
+    const auto count = [&result](std::string_view word) {
+      if (is_counted(word)) {
+          ++result[word];
+      }
+    };
+    finish(stitch_all(join_edges(edges, edge_storage), count), count);
+    return result;
+}
+
+static pid_t spawn(const std::string &executable, const std::vector<std::string> &arguments) {
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(executable.c_str()));
+    for (const auto &argument : arguments) {
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (const int error = posix_spawn(&pid, executable.c_str(), nullptr, nullptr, argv.data(), environ); error != 0) {
+        throw std::runtime_error("cannot run " + executable + ": " + std::strerror(error));
+    }
+    return pid;
+}
+
+FreqMap count_with_shards(const std::string &filename, size_t count, const std::string &executable,
+                          const std::vector<std::string> &arguments) {
+    std::string pattern = (std::filesystem::temp_directory_path() / "freq-shards-XXXXXX").string();
+    if (mkdtemp(pattern.data()) == nullptr) {
+        throw std::runtime_error("cannot create shard directory");
+    }
+    const std::filesystem::path directory = pattern;
+
+    std::vector<std::string> paths;
+    std::vector<pid_t> workers;
+    std::string error;
+    for (size_t i = 0; i < count && error.empty(); ++i) {
+        paths.push_back((directory / ("shard-" + std::to_string(i))).string());
+        auto worker_arguments = arguments;
+        worker_arguments.push_back("--shard=" + std::to_string(i) + "/" + std::to_string(count));
+        worker_arguments.push_back(filename);
+        worker_arguments.push_back(paths.back());
+        try {
+            workers.push_back(spawn(executable, worker_arguments));
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        int status;
+        if (waitpid(workers[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            error = "worker of shard " + std::to_string(i) + " failed";
+        }
+    }
+
+    FreqMap result;
+    if (error.empty()) {
+        try {
+            result = merge_partials(paths);
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+    }
+    std::error_code ignored;
+    std::filesystem::remove_all(directory, ignored);
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    return result;
+}
@@ -0,0 +1,29 @@
+#ifndef FREQ_SRC_SHARD_H
+#define FREQ_SRC_SHARD_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+// Shards split an input into byte ranges which are counted apart, by local
+// worker processes or on other machines, into partial tables. Words cut by
+// range ends are kept in the partial as its edge, so merging partials of all
+// shards of an input gives exactly the counts of the whole input.
+
+// Byte range [begin, end) of shard index of count, shards differ in size by at most a byte.
+std::pair<size_t, size_t> shard_range(size_t file_size, size_t index, size_t count);
+
+// Counts shard index of count of filename and writes its partial table to path.
+void write_partial(const std::string &filename, size_t index, size_t count, const std::string &path);
+
+// Merges partials of all shards of one input, given in any order.
+FreqMap merge_partials(const std::vector<std::string> &paths);
+
+// Runs count worker processes of executable, worker i with arguments followed by
+// --shard=i/count, filename and its partial, in a temporary directory, and merges them.
+FreqMap count_with_shards(const std::string &filename, size_t count, const std::string &executable,
+                          const std::vector<std::string> &arguments);
+
+#endif //FREQ_SRC_SHARD_H
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <queue>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+#include "../libs/threadpool.h"
+#include "freq.h"
+#include "records.h"
+#include "report.h"
+#include "spill.h"
+
+static auto record_order(bool alphabetical) {
+    return report_order(alphabetical, [](const Record &record) {
+      return std::pair<std::string_view, size_t>(record.word, record.count);
+    });
+}
+
+// Words of a partition have their final counts, so rare ones are dropped before sorting.
+static std::vector<Record> sorted_records(const WordMap &words, bool alphabetical) {
+    const size_t min_count = FreqConfig::instance().get_min_count();
+    std::vector<Record> records;
+    records.reserve(words.size());
+    words.for_each([&](std::string_view word, size_t count, uint64_t hash) {
+      if (count >= min_count) {
+          records.push_back({hash, count, std::string(word)});
+      }
+    });
+    std::sort(records.begin(), records.end(), record_order(alphabetical));
+    return records;
+}
+
+Spill::Spill(const std::filesystem::path &parent, size_t table_limit)
+    : limit(table_limit), partitions(new Partition[partition_count]) {
+    std::string pattern = (parent / "freq-spill-XXXXXX").string();
+    if (mkdtemp(pattern.data()) == nullptr) {
+        throw std::runtime_error("cannot create spill directory in " + parent.string());
+    }
+    directory = pattern;
+
+    for (size_t i = 0; i < partition_count; ++i) {
+        partitions[i].file.open(partition_path(i), std::ofstream::binary);
+        if (!partitions[i].file) {
+            throw std::runtime_error("cannot create " + partition_path(i).string());
+        }
+    }
+}
+
+Spill::~Spill() {
+    partitions.reset();
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+}
+
+std::filesystem::path Spill::partition_path(size_t index) const {
+    return directory / ("partition-" + std::to_string(index));
+}
+
+std::filesystem::path Spill::sorted_path(size_t index) const {
+    return directory / ("sorted-" + std::to_string(index));
+}
+
+void Spill::append(size_t index, std::string &data) {
+    auto &partition = partitions[index];
+    std::lock_guard lock(partition.mutex);
+    partition.file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!partition.file) {
+        throw std::runtime_error("cannot write " + partition_path(index).string());
+    }
+    partition.bytes += data.size();
+    data.clear();
+}
+
+void Spill::write(const WordMap &words) {
+    if (words.empty()) {
+        return;
+    }
+    used = true;
+
+    std::vector<std::string> buffers(partition_count);
+    words.for_each([&](std::string_view word, size_t count, uint64_t hash) {
+      const size_t index = partition(hash);
+      append_record(buffers[index], word, count, hash);
+      if (buffers[index].size() >= flush_size) {
+          append(index, buffers[index]);
+      }
+    });
+    for (size_t i = 0; i < partition_count; ++i) {
+        if (!buffers[i].empty()) {
+            append(i, buffers[i]);
+        }
+    }
+}
+
+void Spill::emit_sorted(bool alphabetical, size_t threads, size_t memory_budget,
+                        const std::function<void(std::string_view, size_t)> &emit) {
+    size_t largest = 0;
+    for (size_t i = 0; i < partition_count; ++i) {
+        partitions[i].file.close();
+        largest = std::max(largest, partitions[i].bytes);
+    }
+
+    // Table and sorted records of a partition take about three times its records.
+    const size_t concurrency = std::clamp<size_t>(memory_budget / std::max<size_t>(3 * largest, 1), 1, threads);
+    {
+        auto thread_pool = ThreadPool(concurrency);
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 0; i < partition_count; ++i) {
+            tasks.push_back(thread_pool.enqueue([&, i](size_t) {
+              WordMap words;
+              {
+                  std::ifstream file(partition_path(i), std::ifstream::binary);
+                  Record record;
+                  while (read_record(file, record)) {
+                      words.find_or_insert(record.word, record.hash) += record.count;
+                  }
+              }
+              std::filesystem::remove(partition_path(i));
+
+              const auto records = sorted_records(words, alphabetical);
+              words = WordMap();
+
+              std::ofstream file(sorted_path(i), std::ofstream::binary);
+              std::string buffer;
+              for (const auto &record : records) {
+                  append_record(buffer, record.word, record.count, record.hash);
+                  if (buffer.size() >= flush_size) {
+                      file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                      buffer.clear();
+                  }
+              }
+              file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+              if (!file) {
+                  throw std::runtime_error("cannot write " + sorted_path(i).string());
+              }
+            }));
+        }
+        for (auto &task : tasks) {
+            task.get();
+        }
+    }
+
+    // Every word lives in one partition, so merging sorted partitions gives the report.
+    struct Cursor {
+      std::ifstream file;
+      Record record;
+    };
+    std::vector<Cursor> cursors(partition_count);
+    const auto order = record_order(alphabetical);
+    const auto after = [&](size_t lhs, size_t rhs) { return order(cursors[rhs].record, cursors[lhs].record); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(after);
+    for (size_t i = 0; i < partition_count; ++i) {
+        cursors[i].file.open(sorted_path(i), std::ifstream::binary);
+        if (read_record(cursors[i].file, cursors[i].record)) {
+            heap.push(i);
+        }
+    }
+    while (!heap.empty()) {
+        const size_t i = heap.top();
+        heap.pop();
+        emit(cursors[i].record.word, cursors[i].record.count);
+        if (read_record(cursors[i].file, cursors[i].record)) {
+            heap.push(i);
+        }
+    }
+}
+
+void count_with_spill(const std::string &filename, size_t memory_budget, bool alphabetical,
+                      const std::function<void(std::string_view, size_t)> &emit) {
+    auto &config = FreqConfig::instance();
+    const size_t threads = config.get_processor_count();
+    const size_t read_ahead = config.get_read_ahead();
+    const size_t block_size = config.get_read_block_size();
+
+    // Read buffers take at most a quarter of the budget.
+    const size_t buffer_budget = std::max<size_t>(memory_budget / 4, 1);
+    config.set_read_block_size(std::min(block_size, buffer_budget));
+    config.set_read_ahead(std::clamp<size_t>(buffer_budget / config.get_read_block_size(), 1, read_ahead));
+    const size_t table_budget = memory_budget - config.get_read_ahead() * config.get_read_block_size();
+
+    // A table being rehashed briefly holds its old and its twice larger new slots.
+    Spill spill(std::filesystem::temp_directory_path(), std::max<size_t>(table_budget / (3 * threads), 1));
+    WordMap rest = process_file_spilling(filename, spill);
+
+    config.set_read_block_size(block_size);
+    config.set_read_ahead(read_ahead);
+
+    if (spill.empty()) {
+        for (const auto &record : sorted_records(rest, alphabetical)) {
+            emit(record.word, record.count);
+        }
+        return;
+    }
+
+    spill.write(rest);
+    rest = WordMap();
+    spill.emit_sorted(alphabetical, threads, table_budget, emit);
+}
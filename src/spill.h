@@ -0,0 +1,133 @@
+#ifndef FREQ_SRC_SPILL_H
+#define FREQ_SRC_SPILL_H
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "utils.h"
+
+// On-disk store of word counts, hash partitioned so that every
+// partition can be counted on its own in a fraction of the memory.
+// Entries of a word may be written many times, from many tables,
+// they are summed when partitions are read back.
+class Spill {
+ public:
+  static constexpr size_t partition_bits = 8;
+  static constexpr size_t partition_count = size_t{1} << partition_bits;
+
+  // Partition of a word with WordMap::hash() hash. Tables take home slots from
+  // the top bits of the hash and fingerprints or lengths from the lowest byte,
+  // so the partition comes from the byte above it: words of one partition are
+  // spread over the whole table they are counted in again.
+  static size_t partition(uint64_t hash) {
+      return (hash >> 8) & (partition_count - 1);
+  }
+
+  // Files are created in a new directory under parent, removed with the Spill.
+  Spill(const std::filesystem::path &parent, size_t table_limit);
+  ~Spill();
+
+  Spill(const Spill &) = delete;
+  Spill &operator=(const Spill &) = delete;
+
+  // Bytes a counting table may take before it is written out.
+  [[nodiscard]] size_t table_limit() const {
+      return limit;
+  }
+
+  [[nodiscard]] bool empty() const {
+      return !used;
+  }
+
+  // Appends all entries of words to their partitions, safe to call from many threads.
+  void write(const WordMap &words);
+
+  // Counts partitions, up to threads of them at once within memory_budget,
+  // and calls emit(word, count) for every word in alphabetical order
+  // or by descending count, words of equal count alphabetically.
+  void emit_sorted(bool alphabetical, size_t threads, size_t memory_budget,
+                   const std::function<void(std::string_view, size_t)> &emit);
+
+ private:
+  struct Partition {
+    std::mutex mutex;
+    std::ofstream file;
+    size_t bytes = 0;
+  };
+
+  [[nodiscard]] std::filesystem::path partition_path(size_t index) const;
+  [[nodiscard]] std::filesystem::path sorted_path(size_t index) const;
+  void append(size_t index, std::string &data);
+
+  std::filesystem::path directory;
+  size_t limit;
+  std::atomic<bool> used = false;
+  std::unique_ptr<Partition[]> partitions;
+};
+
+// Counter of the spilling engine: a WordMap which is moved to the
+// Spill whenever it grows past the table limit, and starts empty.
+class SpillingCounter {
+ public:
+  SpillingCounter() = default;
+
+  explicit SpillingCounter(Spill &spill) : spill(&spill) {}
+
+  void reserve(size_t n) {
+      // Presized tables stay well within the limit.
+      words.reserve(std::min(n, spill->table_limit() / 128));
+  }
+
+  size_t &operator[](std::string_view word) {
+      return find_or_insert(word, WordMap::hash(word));
+  }
+
+  [[nodiscard]] static uint64_t hash(std::string_view word) {
+      return WordMap::hash(word);
+  }
+
+  void prefetch(std::string_view word, uint64_t hash) const {
+      words.prefetch(word, hash);
+  }
+
+  size_t &find_or_insert(std::string_view word, uint64_t hash) {
+      if (words.memory_usage() > spill->table_limit()) {
+          spill->write(words);
+          words = WordMap();
+      }
+      return words.find_or_insert(word, hash);
+  }
+
+  // Tables are merged in memory only while both fit the limit.
+  void merge(SpillingCounter &&other) {
+      if (words.memory_usage() + other.words.memory_usage() <= spill->table_limit()) {
+          words.merge(other.words);
+      } else {
+          spill->write(other.words);
+      }
+      other.words = WordMap();
+  }
+
+  // Words which have not been spilled.
+  WordMap take() {
+      return std::move(words);
+  }
+
+ private:
+  Spill *spill = nullptr;
+  WordMap words;
+};
+
+// Counts filename exactly with about memory_budget bytes of buffers and
+// tables, spilling to a temporary directory when words do not fit,
+// and calls emit(word, count) in the order described at Spill::emit_sorted().
+void count_with_spill(const std::string &filename, size_t memory_budget, bool alphabetical,
+                      const std::function<void(std::string_view, size_t)> &emit);
+
+#endif //FREQ_SRC_SPILL_H
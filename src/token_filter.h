@@ -0,0 +1,53 @@
+#ifndef FREQ_SRC_TOKEN_FILTER_H
+#define FREQ_SRC_TOKEN_FILTER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "utils.h"
+#include "vocabulary.h"
+
+// Drops tokens before they reach a table: words shorter or longer than
+// the length limits, and stopwords, looked up in a perfect hash. Tokens
+// of lengths no stopword has skip the lookup.
+class TokenFilter {
+ public:
+  TokenFilter(size_t min_length, size_t max_length, std::optional<Vocabulary> stopwords = std::nullopt)
+      : min_length(min_length), max_length(max_length), stopwords(std::move(stopwords)) {
+      if (this->stopwords) {
+          for (size_t i = 0; i < this->stopwords->size(); ++i) {
+              stopword_lengths |= length_bit(this->stopwords->word(i).size());
+          }
+      }
+  }
+
+  [[nodiscard]] bool accepts(std::string_view word) const {
+      if (word.size() < min_length || word.size() > max_length) {
+          return false;
+      }
+      return (stopword_lengths & length_bit(word.size())) == 0 || stopwords->find(word) == Vocabulary::npos;
+  }
+
+ private:
+  // Lengths from 63 on share the last bit.
+  static uint64_t length_bit(size_t length) {
+      return uint64_t{1} << std::min<size_t>(length, 63);
+  }
+
+  size_t min_length;
+  size_t max_length;
+  std::optional<Vocabulary> stopwords;
+  uint64_t stopword_lengths = 0;
+};
+
+// Whether word is counted under the filter set in FreqConfig.
+inline bool is_counted(std::string_view word) {
+    const TokenFilter *filter = FreqConfig::instance().get_token_filter();
+    return filter == nullptr || filter->accepts(word);
+}
+
+#endif //FREQ_SRC_TOKEN_FILTER_H
@@ -2,8 +2,12 @@
 #define FREQ_SRC_UTILS_H
 
 #include <sys/stat.h>
+#include <limits>
 #include <thread>
 #include "../libs/unordered_dense.h"
+#include "word_map.h"
+
+class TokenFilter;
 
 struct FreqConfig {
   FreqConfig(const FreqConfig &root) = delete;
@@ -18,10 +22,87 @@ struct FreqConfig {
       return processor_count;
   }
 
+  void set_processor_count(size_t count) {
+      processor_count = count;
+  }
+
   [[nodiscard]] size_t get_disk_page_size() const {
       return disk_page_size;
   }
 
+  // Number of words hashed and prefetched ahead of their
+  // insertion into a table, 0 inserts every word right away.
+  [[nodiscard]] size_t get_insert_batch_size() const {
+      return insert_batch_size;
+  }
+
+  void set_insert_batch_size(size_t size) {
+      insert_batch_size = size;
+  }
+
+  // Number of blocks the pipelined engine reads ahead of the
+  // tokenizers, together with the block size it bounds memory.
+  [[nodiscard]] size_t get_read_ahead() const {
+      return read_ahead;
+  }
+
+  void set_read_ahead(size_t blocks) {
+      read_ahead = blocks;
+  }
+
+  [[nodiscard]] size_t get_reader_count() const {
+      return reader_count;
+  }
+
+  void set_reader_count(size_t count) {
+      reader_count = count;
+  }
+
+  [[nodiscard]] size_t get_read_block_size() const {
+      return read_block_size;
+  }
+
+  void set_read_block_size(size_t size) {
+      read_block_size = size;
+  }
+
+  // Engines count at most this many bytes from the start of the file.
+  [[nodiscard]] size_t get_input_limit() const {
+      return input_limit;
+  }
+
+  void set_input_limit(size_t limit) {
+      input_limit = limit;
+  }
+
+  // Words counted fewer times are left out of reports.
+  [[nodiscard]] size_t get_min_count() const {
+      return min_count;
+  }
+
+  void set_min_count(size_t count) {
+      min_count = count;
+  }
+
+  // Lossy counting drops rare words from tables while counting, counts
+  // fall short by at most this fraction of all words, 0 counts exactly.
+  [[nodiscard]] double get_lossy_error() const {
+      return lossy_error;
+  }
+
+  void set_lossy_error(double error) {
+      lossy_error = error;
+  }
+
+  // Tokens are counted only if the filter accepts them, nullptr counts all.
+  [[nodiscard]] const TokenFilter *get_token_filter() const {
+      return token_filter;
+  }
+
+  void set_token_filter(const TokenFilter *filter) {
+      token_filter = filter;
+  }
+
  private:
   FreqConfig() {
       struct stat fi{};
@@ -37,23 +118,19 @@ struct FreqConfig {
 
   size_t processor_count;
   size_t disk_page_size;
+  size_t insert_batch_size = 32;
+  size_t read_ahead = 16;
+  size_t reader_count = 2;
+  size_t read_block_size = size_t{16} << 20;
+  size_t input_limit = std::numeric_limits<size_t>::max();
+  size_t min_count = 1;
+  double lossy_error = 0;
+  const TokenFilter *token_filter = nullptr;
 };
 
 using namespace ankerl::unordered_dense::detail;
 
-struct HeteroStringHash {
-  using is_transparent = std::true_type;
-
-  auto operator()(std::string const &str) const noexcept -> uint64_t {
-      return wyhash::hash(str.data(), sizeof(char) * str.size());
-  }
-
-  auto operator()(std::string_view const &str) const noexcept -> uint64_t {
-      return wyhash::hash(str.data(), sizeof(char) * str.size());
-  }
-};
-
-using FreqMap = ankerl::unordered_dense::map<std::string, size_t, HeteroStringHash, std::equal_to<void>>;
+using FreqMap = WordMap;
 
 static bool is_delim(char c) {
     return !std::isalpha(c);
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "vocabulary.h"
+
+static uint64_t level_hash(uint64_t hash, size_t level, size_t size) {
+    const uint64_t mixed = wyhash::mix(hash, UINT64_C(0x9E3779B97F4A7C15) * (level + 1));
+    // Maps the hash to [0, size) without division.
+    return static_cast<uint64_t>((static_cast<__uint128_t>(mixed) * size) >> 64);
+}
+
+static uint32_t fingerprint(uint64_t hash) {
+    return static_cast<uint32_t>(hash >> 32);
+}
+
+static bool test_bit(const std::vector<uint64_t> &bits, size_t position) {
+    return (bits[position / 64] >> (position % 64)) & 1;
+}
+
+static void set_bit(std::vector<uint64_t> &bits, size_t position) {
+    bits[position / 64] |= uint64_t{1} << (position % 64);
+}
+
+Vocabulary::Vocabulary(std::vector<std::string> words) {
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+
+    std::vector<std::pair<uint64_t, size_t>> keys;
+    keys.reserve(words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        keys.emplace_back(wyhash::hash(words[i].data(), words[i].size()), i);
+    }
+
+    std::vector<uint64_t> occupied;
+    std::vector<uint64_t> collided;
+    size_t offset = 0;
+    for (size_t level = 0; level < max_levels && !keys.empty(); ++level) {
+        const size_t size = std::max<size_t>(64, static_cast<size_t>(gamma * static_cast<double>(keys.size())));
+        const size_t words_count = (size + 63) / 64;
+        occupied.assign(words_count, 0);
+        collided.assign(words_count, 0);
+
+        for (const auto &[hash, index] : keys) {
+            const size_t position = level_hash(hash, level, size);
+            if (test_bit(occupied, position)) {
+                set_bit(collided, position);
+            } else {
+                set_bit(occupied, position);
+            }
+        }
+
+        std::vector<std::pair<uint64_t, size_t>> next;
+        for (const auto &key : keys) {
+            if (test_bit(collided, level_hash(key.first, level, size))) {
+                next.push_back(key);
+            }
+        }
+        for (size_t i = 0; i < words_count; ++i) {
+            occupied[i] &= ~collided[i];
+        }
+
+        bits.insert(bits.end(), occupied.begin(), occupied.end());
+        levels.push_back({offset, size});
+        offset += words_count * 64;
+        keys.swap(next);
+    }
+    fallback = std::move(keys);
+
+    ranks.resize(bits.size());
+    uint64_t rank = 0;
+    for (size_t i = 0; i < bits.size(); ++i) {
+        ranks[i] = rank;
+        rank += std::popcount(bits[i]);
+    }
+
+    // Lay words out by their perfect hash index.
+    std::vector<size_t> order(words.size());
+    for (size_t i = 0; i < fallback.size(); ++i) {
+        order[rank + i] = fallback[i].second;
+        fallback[i].second = rank + i;
+    }
+    for (size_t i = 0; i < words.size(); ++i) {
+        const uint64_t hash = wyhash::hash(words[i].data(), words[i].size());
+        for (size_t level = 0; level < levels.size(); ++level) {
+            const size_t position = levels[level].offset + level_hash(hash, level, levels[level].size);
+            if (test_bit(bits, position)) {
+                order[this->rank(position)] = i;
+                break;
+            }
+        }
+    }
+
+    fingerprints.resize(words.size());
+    offsets.reserve(words.size() + 1);
+    for (size_t index = 0; index < words.size(); ++index) {
+        const auto &w = words[order[index]];
+        fingerprints[index] = fingerprint(wyhash::hash(w.data(), w.size()));
+        offsets.push_back(arena.size());
+        arena += w;
+    }
+    offsets.push_back(arena.size());
+}
+
+Vocabulary Vocabulary::load(const std::string &filename) {
+    std::ifstream file(filename, std::ifstream::binary);
+    if (!file) {
+        throw std::runtime_error("cannot open vocabulary " + filename);
+    }
+    std::string data(std::istreambuf_iterator<char>(file), {});
+    std::transform(data.begin(), data.end(), data.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    std::vector<std::string> words;
+    auto start_it = std::find_if_not(data.begin(), data.end(), is_delim);
+    while (start_it < data.end()) {
+        auto word_end = std::find_if(start_it, data.end(), is_delim);
+        words.emplace_back(start_it, word_end);
+        start_it = std::find_if_not(word_end, data.end(), is_delim);
+    }
+    return Vocabulary(std::move(words));
+}
+
+size_t Vocabulary::rank(size_t position) const {
+    const uint64_t below = bits[position / 64] & ((uint64_t{1} << (position % 64)) - 1);
+    return ranks[position / 64] + std::popcount(below);
+}
+
+size_t Vocabulary::find(std::string_view word) const {
+    const uint64_t hash = wyhash::hash(word.data(), word.size());
+
+    size_t index = npos;
+    for (size_t level = 0; level < levels.size(); ++level) {
+        const size_t position = levels[level].offset + level_hash(hash, level, levels[level].size);
+        if (test_bit(bits, position)) {
+            index = rank(position);
+            break;
+        }
+    }
+    if (index == npos) {
+        const auto it = std::find_if(fallback.begin(), fallback.end(), [&](const auto &key) {
+          return key.first == hash;
+        });
+        if (it == fallback.end()) {
+            return npos;
+        }
+        index = it->second;
+    }
+
+    if (fingerprints[index] != fingerprint(hash) || this->word(index) != word) {
+        return npos;
+    }
+    return index;
+}
+
+// totals[i] += counts[i] for the whole array, widening 32-bit counters.
+static void accumulate(uint64_t *totals, const uint32_t *counts, size_t size) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= size; i += 4) {
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(counts + i));
+        auto *t = reinterpret_cast<__m128i *>(totals + i);
+        _mm_storeu_si128(t, _mm_add_epi64(_mm_loadu_si128(t), _mm_unpacklo_epi32(c, zero)));
+        _mm_storeu_si128(t + 1, _mm_add_epi64(_mm_loadu_si128(t + 1), _mm_unpackhi_epi32(c, zero)));
+    }
+#endif
+    for (; i < size; ++i) {
+        totals[i] += counts[i];
+    }
+}
+
+void VocabCounter::merge(VocabCounter &&other) {
+    if (totals.empty()) {
+        totals.assign(counts.size(), 0);
+    }
+    accumulate(totals.data(), other.counts.data(), other.counts.size());
+    for (size_t index : other.overflows) {
+        totals[index] += uint64_t{1} << 32;
+    }
+    for (size_t i = 0; i < other.totals.size(); ++i) {
+        totals[i] += other.totals[i];
+    }
+}
+
+FreqMap VocabCounter::to_freq_map() const {
+    FreqMap result;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        const uint64_t count = counts[i] + (totals.empty() ? 0 : totals[i]);
+        if (count != 0) {
+            result[vocabulary->word(i)] = count;
+        }
+    }
+    for (size_t index : overflows) {
+        result[vocabulary->word(index)] += uint64_t{1} << 32;
+    }
+    return result;
+}
@@ -0,0 +1,94 @@
+#ifndef FREQ_SRC_VOCABULARY_H
+#define FREQ_SRC_VOCABULARY_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils.h"
+
+// Fixed dictionary indexed by a minimal perfect hash (BBHash style).
+// Every level is a bit array of gamma * (keys left) bits, a key
+// owns the bit it alone hashed to, colliding keys go to the next
+// level. Index of a key is the rank of its bit. A fingerprint and
+// the stored word reject tokens which are not in the dictionary.
+class Vocabulary {
+ public:
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  explicit Vocabulary(std::vector<std::string> words);
+
+  // Reads words from file, tokenized and lowercased the same way as counted text.
+  static Vocabulary load(const std::string &filename);
+
+  [[nodiscard]] size_t size() const {
+      return fingerprints.size();
+  }
+
+  [[nodiscard]] std::string_view word(size_t index) const {
+      return std::string_view(arena).substr(offsets[index], offsets[index + 1] - offsets[index]);
+  }
+
+  // Returns index of the word in [0, size()) or npos if the word is unknown.
+  [[nodiscard]] size_t find(std::string_view word) const;
+
+ private:
+  static constexpr double gamma = 2.0;
+  static constexpr size_t max_levels = 32;
+
+  struct Level {
+    size_t offset;
+    size_t size;
+  };
+
+  [[nodiscard]] size_t rank(size_t position) const;
+
+  std::vector<Level> levels;
+  // Concatenated bit arrays of all levels and number of set bits before every 64-bit word.
+  std::vector<uint64_t> bits;
+  std::vector<uint64_t> ranks;
+  // Keys which still collided on the last level, with their indices.
+  std::vector<std::pair<uint64_t, size_t>> fallback;
+
+  std::vector<uint32_t> fingerprints;
+  std::string arena;
+  std::vector<size_t> offsets;
+};
+
+// Per-thread counters over a Vocabulary: unknown words are dropped,
+// known ones increment a flat uint32_t slot, no allocation per token.
+class VocabCounter {
+ public:
+  VocabCounter() = default;
+
+  explicit VocabCounter(const Vocabulary &vocabulary)
+      : vocabulary(&vocabulary), counts(vocabulary.size()) {}
+
+  // Nothing to preallocate, kept to be interchangeable with FreqMap.
+  void reserve(size_t) {}
+
+  void add(std::string_view word) {
+      const size_t index = vocabulary->find(word);
+      if (index != Vocabulary::npos && ++counts[index] == 0) {
+          // Rare wrap around of a 32-bit counter.
+          overflows.push_back(index);
+      }
+  }
+
+  // Sums counters of other into this one with SIMD.
+  void merge(VocabCounter &&other);
+
+  // Words with non-zero counts.
+  [[nodiscard]] FreqMap to_freq_map() const;
+
+ private:
+  const Vocabulary *vocabulary = nullptr;
+  std::vector<uint32_t> counts;
+  std::vector<size_t> overflows;
+  // Merged 64-bit totals, allocated by the first merge.
+  std::vector<uint64_t> totals;
+};
+
+#endif //FREQ_SRC_VOCABULARY_H
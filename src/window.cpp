@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "counter.h"
+#include "freq.h"
+#include "report.h"
+#include "token_filter.h"
+#include "window.h"
+
+size_t parse_timestamp(std::string_view line, int64_t &seconds) {
+    size_t i = line.starts_with('[') ? 1 : 0;
+    const auto number = [&](size_t length, int &value) {
+      value = 0;
+      for (const size_t end = i + length; i < end; ++i) {
+          if (i >= line.size() || !std::isdigit(static_cast<unsigned char>(line[i]))) {
+              return false;
+          }
+          value = value * 10 + (line[i] - '0');
+      }
+      return true;
+    };
+    const auto skip = [&](std::string_view chars) {
+      if (i < line.size() && chars.find(line[i]) != std::string_view::npos) {
+          ++i;
+          return true;
+      }
+      return false;
+    };
+    const auto skip_fraction = [&] {
+      if (i + 1 < line.size() && (line[i] == '.' || line[i] == ',')
+          && std::isdigit(static_cast<unsigned char>(line[i + 1]))) {
+          for (++i; i < line.size() && std::isdigit(static_cast<unsigned char>(line[i])); ++i) {}
+      }
+    };
+
+    if (line.size() > i + 4 && line[i + 4] == '-') {
+        int year, month, day, hours, minutes, secs;
+        if (!number(4, year) || !skip("-") || !number(2, month) || !skip("-") || !number(2, day)
+            || !skip("T ") || !number(2, hours) || !skip(":") || !number(2, minutes) || !skip(":")
+            || !number(2, secs)) {
+            return 0;
+        }
+        const std::chrono::year_month_day date{std::chrono::year(year), std::chrono::month(month),
+                                               std::chrono::day(day)};
+        if (!date.ok() || hours > 23 || minutes > 59 || secs > 60) {
+            return 0;
+        }
+        skip_fraction();
+        int offset = 0;
+        if (i < line.size() && (line[i] == '+' || line[i] == '-')) {
+            const int sign = line[i++] == '-' ? -1 : 1;
+            int offset_hours, offset_minutes;
+            if (!number(2, offset_hours)) {
+                return 0;
+            }
+            skip(":");
+            if (!number(2, offset_minutes)) {
+                return 0;
+            }
+            offset = sign * (offset_hours * 3600 + offset_minutes * 60);
+        } else {
+            skip("Z");
+        }
+        const auto days = std::chrono::sys_days(date).time_since_epoch().count();
+        seconds = int64_t{days} * 86400 + hours * 3600 + minutes * 60 + secs - offset;
+        return i;
+    }
+
+    const auto [end, ec] = std::from_chars(line.data() + i, line.data() + line.size(), seconds);
+    if (ec != std::errc() || end - (line.data() + i) < 9 || seconds < 0) {
+        return 0;
+    }
+    i = end - line.data();
+    skip_fraction();
+    return i;
+}
+
+std::string format_timestamp(int64_t seconds) {
+    const std::chrono::sys_seconds time{std::chrono::seconds(seconds)};
+    const auto day = std::chrono::floor<std::chrono::days>(time);
+    const std::chrono::year_month_day date(day);
+    const std::chrono::hh_mm_ss clock(time - day);
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02uT%02d:%02d:%02dZ", static_cast<int>(date.year()),
+                  static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()),
+                  static_cast<int>(clock.hours().count()), static_cast<int>(clock.minutes().count()),
+                  static_cast<int>(clock.seconds().count()));
+    return buffer;
+}
+
+WindowCounter::WindowCounter(int64_t window, int64_t step, size_t top, Emit emit)
+    : step(step), top(top), emit(std::move(emit)), buckets(static_cast<size_t>(window / step)) {}
+
+void WindowCounter::feed(std::span<const char> data) {
+    for_each_piece(data, [this](std::span<const char> piece) {
+      const auto last_line_end = std::find(piece.rbegin(), piece.rend(), '\n').base();
+      if (last_line_end == piece.begin()) {
+          pending.append(piece.begin(), piece.end());
+          return;
+      }
+      pending.append(piece.begin(), last_line_end);
+      count_lines(pending);
+      pending.assign(last_line_end, piece.end());
+    });
+}
+
+void WindowCounter::finish() {
+    count_lines(pending);
+    pending.clear();
+    close_bucket();
+}
+
+size_t WindowCounter::slot(int64_t bucket) const {
+    const auto count = static_cast<int64_t>(buckets.size());
+    return static_cast<size_t>((bucket % count + count) % count);
+}
+
+void WindowCounter::count_lines(std::span<char> lines) {
+    char *run = lines.data();
+    char *const end = run + lines.size();
+    for (char *line = run; line < end;) {
+        char *const line_end = std::find(line, end, '\n');
+        int64_t seconds;
+        const size_t length = parse_timestamp(std::string_view(line, line_end - line), seconds);
+        if (length > 0) {
+            std::fill(line, line + length, ' ');
+            const int64_t bucket = seconds / step - (seconds % step < 0);
+            if (!started) {
+                // Lines before the first timestamp were counted in bucket 0.
+                count_bucket(std::span(run, line));
+                run = line;
+                std::swap(buckets[slot(current)], buckets[slot(bucket)]);
+                current = bucket;
+                started = true;
+            } else if (bucket > current) {
+                count_bucket(std::span(run, line));
+                run = line;
+                advance(bucket);
+            }
+        }
+        line = line_end == end ? end : line_end + 1;
+    }
+    count_bucket(std::span(run, end));
+}
+
+void WindowCounter::count_bucket(std::span<char> text) {
+    FreqMap &words = buckets[slot(current)];
+    ::finish(count_chunk(text, words), [&words](std::string_view word) {
+      if (is_counted(word)) {
+          ++words[word];
+      }
+    });
+}
+
+void WindowCounter::advance(int64_t bucket) {
+    while (current < bucket) {
+        const size_t live = close_bucket();
+        ++current;
+        FreqMap &expired = buckets[slot(current)];
+        expired.for_each([this](std::string_view word, size_t count, uint64_t hash) {
+          totals.find_or_insert(word, hash) -= count;
+        });
+        expired = FreqMap();
+        // All buckets are empty, nothing is left to emit before bucket.
+        if (live == 0) {
+            current = bucket;
+        }
+    }
+}
+
+size_t WindowCounter::close_bucket() {
+    totals.merge(buckets[slot(current)]);
+
+    const auto order = report_order(false);
+    // Heap of the best entries so far, the worst of them on top.
+    std::vector<std::pair<std::string_view, size_t>> best;
+    size_t live = 0;
+    const size_t min_count = std::max<size_t>(FreqConfig::instance().get_min_count(), 1);
+    totals.for_each([&](std::string_view word, size_t count, uint64_t) {
+      if (count == 0) {
+          return;
+      }
+      ++live;
+      if (count < min_count || top == 0) {
+          return;
+      }
+      const std::pair entry(word, count);
+      if (best.size() < top) {
+          best.push_back(entry);
+          std::push_heap(best.begin(), best.end(), order);
+      } else if (order(entry, best.front())) {
+          std::pop_heap(best.begin(), best.end(), order);
+          best.back() = entry;
+          std::push_heap(best.begin(), best.end(), order);
+      }
+    });
+
+    if (live > 0) {
+        std::sort_heap(best.begin(), best.end(), order);
+        std::vector<std::pair<std::string, size_t>> result(best.begin(), best.end());
+        emit((current + 1) * step, result);
+    }
+    if (2 * live < totals.size()) {
+        totals.retain([](std::string_view, size_t count) { return count > 0; });
+    }
+    return live;
+}
+
+void count_log(const std::string &filename, WindowCounter &counter) {
+    const bool standard_input = filename == "-";
+    const int fd = standard_input ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + filename + ": " + std::strerror(errno));
+    }
+    std::vector<char> buffer(piece_size);
+    for (;;) {
+        const ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            const int error = errno;
+            if (!standard_input) {
+                close(fd);
+            }
+            throw std::runtime_error("cannot read " + filename + ": " + std::strerror(error));
+        }
+        if (n == 0) {
+            break;
+        }
+        counter.feed(std::span(buffer.data(), static_cast<size_t>(n)));
+    }
+    if (!standard_input) {
+        close(fd);
+    }
+    counter.finish();
+}
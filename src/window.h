@@ -0,0 +1,77 @@
+#ifndef FREQ_SRC_WINDOW_H
+#define FREQ_SRC_WINDOW_H
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+// Parses the timestamp a log line starts with, optionally after '[':
+// seconds since the epoch, with at least 9 digits and an optional fraction,
+// or ISO 8601 "YYYY-MM-DD[T ]HH:MM:SS[.fraction][Z|+HH:MM|-HH:MM]".
+// Returns the length of the timestamp, 0 if the line does not start with one.
+size_t parse_timestamp(std::string_view line, int64_t &seconds);
+
+// ISO 8601 UTC time of seconds since the epoch, "YYYY-MM-DDTHH:MM:SSZ".
+std::string format_timestamp(int64_t seconds);
+
+// Counts words of lines with leading timestamps in sliding time windows,
+// fed in pieces of any size. Time is cut into buckets of step seconds,
+// each counted in its own table of a ring as long as the window. Whenever
+// a bucket ends, its table is added to the totals of the window, top
+// words of the window ending there are emitted, and the bucket leaving
+// the window is subtracted from the totals, so tables are never rebuilt.
+// Lines are expected in time order: lines older than the current bucket
+// and lines without a timestamp are counted in it. Not safe to share
+// between threads.
+class WindowCounter {
+ public:
+  using Emit = std::function<void(int64_t end, const std::vector<std::pair<std::string, size_t>> &top)>;
+
+  // Windows of window seconds, a multiple of step, ending every step seconds.
+  // emit gets up to top most frequent words of every window with any words
+  // by descending count, equal counts alphabetically.
+  WindowCounter(int64_t window, int64_t step, size_t top, Emit emit);
+
+  // Counts the next piece of the log.
+  void feed(std::span<const char> data);
+
+  // Counts the last line and emits the window ending with its bucket, once at the end of the log.
+  void finish();
+
+ private:
+  // Counts whole lines, blanking their timestamps in place.
+  void count_lines(std::span<char> lines);
+  // Counts lines of text in the current bucket.
+  void count_bucket(std::span<char> text);
+  // Ends buckets up to bucket, which becomes the current one.
+  void advance(int64_t bucket);
+  // Adds the current bucket to the totals and emits the window ending
+  // with it, returns the number of words in the window.
+  size_t close_bucket();
+  [[nodiscard]] size_t slot(int64_t bucket) const;
+
+  int64_t step;
+  size_t top;
+  Emit emit;
+  // Bucket b is counted in buckets[b % buckets.size()].
+  std::vector<FreqMap> buckets;
+  // Entries counted down to 0 are dropped once they are most of the table.
+  FreqMap totals;
+  int64_t current = 0;
+  bool started = false;
+  // Copy of the lines fed and not counted yet, the last one unfinished.
+  // Lines are counted, and lowercased, in place once they are whole.
+  std::string pending;
+};
+
+// Feeds the log in filename to counter as it is read, "-" for standard
+// input, whose lines are counted as they come, then finishes it.
+void count_log(const std::string &filename, WindowCounter &counter);
+
+#endif //FREQ_SRC_WINDOW_H
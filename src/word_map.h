@@ -0,0 +1,605 @@
+#ifndef FREQ_SRC_WORD_MAP_H
+#define FREQ_SRC_WORD_MAP_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "../libs/unordered_dense.h"
+#include "huge_page_allocator.h"
+
+// Long words keep their hash next to the string, so merging
+// tables or routing entries by hash never hashes them again.
+struct HashedWordView {
+  std::string_view word;
+  uint64_t hash;
+};
+
+struct HashedWord {
+  std::string word;
+  uint64_t hash;
+
+  explicit HashedWord(const HashedWordView &view) : word(view.word), hash(view.hash) {}
+
+  bool operator==(const HashedWord &other) const {
+      return hash == other.hash && word == other.word;
+  }
+
+  bool operator==(const HashedWordView &other) const {
+      return hash == other.hash && word == other.word;
+  }
+};
+
+struct HashedWordHash {
+  using is_transparent = std::true_type;
+  using is_avalanching = void;
+
+  auto operator()(HashedWord const &word) const noexcept -> uint64_t {
+      return word.hash;
+  }
+
+  auto operator()(HashedWordView const &word) const noexcept -> uint64_t {
+      return word.hash;
+  }
+};
+
+template<class Allocator, class Value = size_t>
+using LongWordMap = ankerl::unordered_dense::map<
+    HashedWord, Value, HashedWordHash, std::equal_to<void>,
+    typename std::allocator_traits<Allocator>::template rebind_alloc<std::pair<HashedWord, Value>>
+>;
+
+// Open addressing table for words not longer than Width bytes.
+// Keys are stored inline, zero padded to Width, so lookups never
+// chase a pointer to string data. Every slot keeps a tag: the hash
+// of the key with the key length in the low byte (0 marks an empty
+// slot), so most mismatches are rejected by a single integer compare
+// and the rest by one SIMD compare of the whole key.
+template<size_t Width, class Allocator, class Value = size_t>
+class InlineKeyTable {
+  static_assert(Width % 16 == 0 && Width < 256);
+
+ public:
+  static constexpr size_t max_length = Width;
+
+  struct Slot {
+    alignas(16) char key[Width];
+    Value count;
+    uint64_t tag;
+
+    [[nodiscard]] std::string_view word() const {
+        return {key, static_cast<size_t>(tag & 0xFF)};
+    }
+  };
+
+  InlineKeyTable() = default;
+  // A moved from table is empty and can be filled again.
+  InlineKeyTable(InlineKeyTable &&other) noexcept
+      : slots(std::move(other.slots)),
+        slots_count(std::exchange(other.slots_count, 0)),
+        occupied(std::exchange(other.occupied, 0)),
+        mask(std::exchange(other.mask, 0)),
+        shift(std::exchange(other.shift, 64)) {}
+
+  InlineKeyTable &operator=(InlineKeyTable &&other) noexcept {
+      if (this != &other) {
+          slots = std::move(other.slots);
+          slots_count = std::exchange(other.slots_count, 0);
+          occupied = std::exchange(other.occupied, 0);
+          mask = std::exchange(other.mask, 0);
+          shift = std::exchange(other.shift, 64);
+      }
+      return *this;
+  }
+
+  InlineKeyTable(const InlineKeyTable &other)
+      : slots(allocate(other.slots_count, false)),
+        slots_count(other.slots_count),
+        occupied(other.occupied),
+        mask(other.mask),
+        shift(other.shift) {
+      std::copy_n(other.slots.get(), slots_count, slots.get());
+  }
+
+  InlineKeyTable &operator=(const InlineKeyTable &other) {
+      if (this != &other) {
+          *this = InlineKeyTable(other);
+      }
+      return *this;
+  }
+
+  struct alignas(16) Key {
+    char bytes[Width]{};
+    uint64_t tag;
+
+    explicit Key(std::string_view word) {
+        std::memcpy(bytes, word.data(), word.size());
+        tag = (hash(bytes, word.size()) & ~uint64_t{0xFF}) | word.size();
+    }
+
+    Key(std::string_view word, uint64_t tag) : tag(tag) {
+        std::memcpy(bytes, word.data(), word.size());
+    }
+  };
+
+  void reserve(size_t n) {
+      size_t capacity = 16;
+      while (capacity * max_load_num < n * max_load_den) {
+          capacity *= 2;
+      }
+      if (capacity > slots_count) {
+          rehash(capacity);
+      }
+  }
+
+  [[nodiscard]] size_t size() const {
+      return occupied;
+  }
+
+  [[nodiscard]] size_t capacity() const {
+      return slots_count;
+  }
+
+  [[nodiscard]] const Slot &slot(size_t index) const {
+      return slots[index];
+  }
+
+  Value &operator[](std::string_view word) {
+      const Key key(word);
+      return find_or_insert(key.bytes, key.tag);
+  }
+
+  Value &find_or_insert(const char *bytes, uint64_t tag) {
+      if ((occupied + 1) * max_load_den > slots_count * max_load_num) {
+          rehash(std::max<size_t>(16, slots_count * 2));
+      }
+
+      for (size_t index = tag >> shift;; index = (index + 1) & mask) {
+          Slot &slot = slots[index];
+          if (slot.tag == tag && keys_equal(slot.key, bytes)) {
+              return slot.count;
+          }
+          if (slot.tag == 0) {
+              std::memcpy(slot.key, bytes, Width);
+              slot.tag = tag;
+              slot.count = Value{};
+              ++occupied;
+              return slot.count;
+          }
+      }
+  }
+
+  // Pulls the slot a key with this tag probes first into cache.
+  void prefetch(uint64_t tag) const {
+      if (slots_count != 0) {
+          __builtin_prefetch(&slots[tag >> shift]);
+      }
+  }
+
+  // Keeps the slots keep(slot) holds for, in a table sized for them.
+  template<class Keep>
+  void retain(Keep &&keep) {
+      size_t kept = 0;
+      for (size_t i = 0; i < slots_count; ++i) {
+          kept += slots[i].tag != 0 && keep(slots[i]);
+      }
+      SlotsPtr old = std::move(slots);
+      const size_t old_count = slots_count;
+      *this = InlineKeyTable();
+      reserve(kept);
+      for (size_t i = 0; i < old_count; ++i) {
+          if (old[i].tag != 0 && keep(old[i])) {
+              place(old[i]);
+              ++occupied;
+          }
+      }
+  }
+
+  // Slots already carry padded keys and tags, so nothing is rehashed.
+  void merge(const InlineKeyTable &other) {
+      for (size_t i = 0; i < other.slots_count; ++i) {
+          const Slot &slot = other.slots[i];
+          if (slot.tag != 0) {
+              find_or_insert(slot.key, slot.tag) += slot.count;
+          }
+      }
+  }
+
+  [[nodiscard]] Value find(const Key &key) const {
+      if (slots_count == 0) {
+          return Value{};
+      }
+      for (size_t index = key.tag >> shift;; index = (index + 1) & mask) {
+          const Slot &slot = slots[index];
+          if (slot.tag == key.tag && keys_equal(slot.key, key.bytes)) {
+              return slot.count;
+          }
+          if (slot.tag == 0) {
+              return Value{};
+          }
+      }
+  }
+
+ private:
+  static constexpr size_t max_load_num = 7;
+  static constexpr size_t max_load_den = 10;
+
+  // Length specialized hash: the key is already zero padded to Width,
+  // so it is folded as whole 8-byte words without any tail handling.
+  static uint64_t hash(const char *bytes, size_t length) {
+      using ankerl::unordered_dense::detail::wyhash::mix;
+      using ankerl::unordered_dense::detail::wyhash::r8;
+
+      const auto *p = reinterpret_cast<const uint8_t *>(bytes);
+      uint64_t seed = UINT64_C(0xa0761d6478bd642f) ^ length;
+      for (size_t i = 0; i < Width; i += 16) {
+          seed = mix(r8(p + i) ^ UINT64_C(0xe7037ed1a0b428db), r8(p + i + 8) ^ seed);
+      }
+      return mix(seed, UINT64_C(0x8ebc6af09c88c6e3));
+  }
+
+  static bool keys_equal(const char *lhs, const char *rhs) {
+#if defined(__AVX2__)
+      if constexpr (Width == 32) {
+          const auto l = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs));
+          const auto r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs));
+          return _mm256_movemask_epi8(_mm256_cmpeq_epi8(l, r)) == -1;
+      }
+#endif
+#if defined(__SSE2__)
+      for (size_t i = 0; i < Width; i += 16) {
+          const auto l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhs + i));
+          const auto r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhs + i));
+          if (_mm_movemask_epi8(_mm_cmpeq_epi8(l, r)) != 0xFFFF) {
+              return false;
+          }
+      }
+      return true;
+#else
+      return std::memcmp(lhs, rhs, Width) == 0;
+#endif
+  }
+
+  using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+  using SlotAllocatorTraits = std::allocator_traits<SlotAllocator>;
+
+  // Allocators are expected to be stateless.
+  struct SlotsDeleter {
+    size_t count = 0;
+
+    void operator()(Slot *ptr) const {
+        SlotAllocator allocator;
+        SlotAllocatorTraits::deallocate(allocator, ptr, count);
+    }
+  };
+
+  using SlotsPtr = std::unique_ptr<Slot[], SlotsDeleter>;
+
+  // Allocators handing out zero filled memory (fresh kernel pages)
+  // let a generously reserved table cost nothing until it is touched.
+  static SlotsPtr allocate(size_t count, bool zero) {
+      if (count == 0) {
+          return SlotsPtr(nullptr, SlotsDeleter{});
+      }
+      SlotAllocator allocator;
+      Slot *ptr = SlotAllocatorTraits::allocate(allocator, count);
+      if (zero && !allocator_zeroes_memory<Allocator>::value) {
+          std::memset(static_cast<void *>(ptr), 0, count * sizeof(Slot));
+      }
+      return SlotsPtr(ptr, SlotsDeleter{count});
+  }
+
+  void rehash(size_t capacity) {
+      SlotsPtr old = allocate(capacity, true);
+      const size_t old_count = slots_count;
+      old.swap(slots);
+      slots_count = capacity;
+      mask = capacity - 1;
+      shift = 64 - std::countr_zero(capacity);
+
+      for (size_t i = 0; i < old_count; ++i) {
+          if (old[i].tag != 0) {
+              place(old[i]);
+          }
+      }
+  }
+
+  // Copies a slot known to be absent to its first free position.
+  void place(const Slot &slot) {
+      size_t index = slot.tag >> shift;
+      while (slots[index].tag != 0) {
+          index = (index + 1) & mask;
+      }
+      slots[index] = slot;
+  }
+
+  SlotsPtr slots;
+  size_t slots_count = 0;
+  size_t occupied = 0;
+  size_t mask = 0;
+  size_t shift = 64;
+};
+
+// Word -> count map specialized for natural language text.
+// Value is the count, or an entry with more per word data
+// which supports += for merging.
+// Words up to 16 and 32 bytes live in inline key tables,
+// longer ones fall back to a regular string keyed map.
+// All tables take their storage from Allocator, by default
+// huge pages to keep TLB misses of random probes low.
+// Iteration yields std::pair<std::string, Value> by value.
+template<class Allocator = HugePageAllocator<char>, class Value = size_t>
+class BasicWordMap {
+ public:
+  using key_type = std::string;
+  using mapped_type = Value;
+  using value_type = std::pair<std::string, Value>;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = BasicWordMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = value_type;
+    using pointer = void;
+
+    const_iterator() = default;
+
+    value_type operator*() const {
+        switch (stage) {
+            case SHORT: {
+                const auto &slot = map->short_words.slot(index);
+                return {std::string(slot.word()), slot.count};
+            }
+            case MEDIUM: {
+                const auto &slot = map->medium_words.slot(index);
+                return {std::string(slot.word()), slot.count};
+            }
+            default:
+                return {long_it->first.word, long_it->second};
+        }
+    }
+
+    const_iterator &operator++() {
+        if (stage == LONG) {
+            ++long_it;
+        } else {
+            ++index;
+        }
+        skip_empty();
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        auto copy = *this;
+        ++*this;
+        return copy;
+    }
+
+    bool operator==(const const_iterator &other) const {
+        return stage == other.stage && index == other.index && long_it == other.long_it;
+    }
+
+   private:
+    friend class BasicWordMap;
+
+    enum Stage { SHORT, MEDIUM, LONG };
+
+    const_iterator(const BasicWordMap *map, Stage stage, size_t index,
+                   typename LongWordMap<Allocator, Value>::const_iterator long_it)
+        : map(map), stage(stage), index(index), long_it(long_it) {
+        skip_empty();
+    }
+
+    void skip_empty() {
+        if (stage == SHORT) {
+            while (index < map->short_words.capacity() && map->short_words.slot(index).tag == 0) {
+                ++index;
+            }
+            if (index < map->short_words.capacity()) {
+                return;
+            }
+            stage = MEDIUM;
+            index = 0;
+        }
+        if (stage == MEDIUM) {
+            while (index < map->medium_words.capacity() && map->medium_words.slot(index).tag == 0) {
+                ++index;
+            }
+            if (index < map->medium_words.capacity()) {
+                return;
+            }
+            stage = LONG;
+            index = 0;
+        }
+    }
+
+    const BasicWordMap *map = nullptr;
+    Stage stage = LONG;
+    size_t index = 0;
+    typename LongWordMap<Allocator, Value>::const_iterator long_it{};
+  };
+
+  BasicWordMap() = default;
+  BasicWordMap(const BasicWordMap &) = default;
+  BasicWordMap &operator=(const BasicWordMap &) = default;
+
+  // A moved from map is empty and can be filled again.
+  BasicWordMap(BasicWordMap &&other) noexcept
+      : short_words(std::move(other.short_words)),
+        medium_words(std::move(other.medium_words)),
+        long_words(std::move(other.long_words)),
+        long_bytes(std::exchange(other.long_bytes, 0)) {}
+
+  BasicWordMap &operator=(BasicWordMap &&other) noexcept {
+      if (this != &other) {
+          short_words = std::move(other.short_words);
+          medium_words = std::move(other.medium_words);
+          long_words = std::move(other.long_words);
+          long_bytes = std::exchange(other.long_bytes, 0);
+      }
+      return *this;
+  }
+
+  void reserve(size_t n) {
+      // Most words are short, longer ones are reserved on demand.
+      short_words.reserve(n);
+  }
+
+  [[nodiscard]] size_t size() const {
+      return short_words.size() + medium_words.size() + long_words.size();
+  }
+
+  [[nodiscard]] bool empty() const {
+      return size() == 0;
+  }
+
+  Value &operator[](std::string_view word) {
+      if (word.size() - 1 < ShortTable::max_length) {
+          return short_words[word];
+      }
+      if (word.size() - 1 < MediumTable::max_length) {
+          return medium_words[word];
+      }
+      return long_word(HashedWordView{word, hash(word)});
+  }
+
+  // Hash under which the word is stored. The same value is
+  // passed to for_each() callbacks, so entries can be moved
+  // between maps (merge, sharding, spilling) without rehashing.
+  [[nodiscard]] static uint64_t hash(std::string_view word) {
+      if (word.size() - 1 < ShortTable::max_length) {
+          return typename ShortTable::Key(word).tag;
+      }
+      if (word.size() - 1 < MediumTable::max_length) {
+          return typename MediumTable::Key(word).tag;
+      }
+      return ankerl::unordered_dense::detail::wyhash::hash(word.data(), word.size());
+  }
+
+  // Same as operator[] for a word whose hash() is already known.
+  Value &find_or_insert(std::string_view word, uint64_t hash) {
+      if (word.size() - 1 < ShortTable::max_length) {
+          const typename ShortTable::Key key(word, hash);
+          return short_words.find_or_insert(key.bytes, key.tag);
+      }
+      if (word.size() - 1 < MediumTable::max_length) {
+          const typename MediumTable::Key key(word, hash);
+          return medium_words.find_or_insert(key.bytes, key.tag);
+      }
+      return long_word(HashedWordView{word, hash});
+  }
+
+  // Starts loading the slot a word with known hash() will be inserted to.
+  void prefetch(std::string_view word, uint64_t hash) const {
+      if (word.size() - 1 < ShortTable::max_length) {
+          short_words.prefetch(hash);
+      } else if (word.size() - 1 < MediumTable::max_length) {
+          medium_words.prefetch(hash);
+      }
+  }
+
+  // Calls f(word, count, hash) for every entry without materializing strings.
+  template<class F>
+  void for_each(F &&f) const {
+      for (size_t i = 0; i < short_words.capacity(); ++i) {
+          const auto &slot = short_words.slot(i);
+          if (slot.tag != 0) {
+              f(slot.word(), slot.count, slot.tag);
+          }
+      }
+      for (size_t i = 0; i < medium_words.capacity(); ++i) {
+          const auto &slot = medium_words.slot(i);
+          if (slot.tag != 0) {
+              f(slot.word(), slot.count, slot.tag);
+          }
+      }
+      for (const auto &[word, count] : long_words) {
+          f(std::string_view(word.word), count, word.hash);
+      }
+  }
+
+  // Returns count of the word, 0 if it was never added.
+  [[nodiscard]] Value get(std::string_view word) const {
+      if (word.size() - 1 < ShortTable::max_length) {
+          return short_words.find(typename ShortTable::Key(word));
+      }
+      if (word.size() - 1 < MediumTable::max_length) {
+          return medium_words.find(typename MediumTable::Key(word));
+      }
+      auto it = long_words.find(HashedWordView{word, hash(word)});
+      return it == long_words.end() ? Value{} : it->second;
+  }
+
+  // Drops entries keep(word, count) does not hold for, tables shrink to fit the rest.
+  template<class Keep>
+  void retain(Keep &&keep) {
+      short_words.retain([&](const auto &slot) { return keep(slot.word(), slot.count); });
+      medium_words.retain([&](const auto &slot) { return keep(slot.word(), slot.count); });
+      std::erase_if(long_words, [&](const auto &entry) {
+        if (keep(std::string_view(entry.first.word), entry.second)) {
+            return false;
+        }
+        long_bytes -= entry.first.word.size() + 1;
+        return true;
+      });
+  }
+
+  void merge(const BasicWordMap &other) {
+      short_words.merge(other.short_words);
+      medium_words.merge(other.medium_words);
+      for (const auto &[word, count] : other.long_words) {
+          long_word(HashedWordView{word.word, word.hash}) += count;
+      }
+  }
+
+  // Bytes allocated by the tables and the strings of long words.
+  [[nodiscard]] size_t memory_usage() const {
+      using LongEntry = typename LongWordMap<Allocator, Value>::value_type;
+      return short_words.capacity() * sizeof(typename ShortTable::Slot)
+          + medium_words.capacity() * sizeof(typename MediumTable::Slot)
+          + long_words.size() * sizeof(LongEntry) + long_words.bucket_count() * sizeof(uint64_t)
+          + long_bytes;
+  }
+
+  [[nodiscard]] const_iterator begin() const {
+      return {this, const_iterator::SHORT, 0, long_words.begin()};
+  }
+
+  [[nodiscard]] const_iterator end() const {
+      return {this, const_iterator::LONG, 0, long_words.end()};
+  }
+
+ private:
+  using ShortTable = InlineKeyTable<16, Allocator, Value>;
+  using MediumTable = InlineKeyTable<32, Allocator, Value>;
+
+  Value &long_word(const HashedWordView &word) {
+      const auto [it, inserted] = long_words.try_emplace(word, Value{});
+      if (inserted) {
+          long_bytes += word.word.size() + 1;
+      }
+      return it->second;
+  }
+
+  ShortTable short_words;
+  MediumTable medium_words;
+  LongWordMap<Allocator, Value> long_words;
+  size_t long_bytes = 0;
+};
+
+using WordMap = BasicWordMap<>;
+
+#endif //FREQ_SRC_WORD_MAP_H
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "word_tree.h"
+
+static size_t common_prefix(std::string_view lhs, std::string_view rhs) {
+    return std::mismatch(lhs.begin(), lhs.begin() + static_cast<std::ptrdiff_t>(std::min(lhs.size(), rhs.size())),
+                         rhs.begin()).first - lhs.begin();
+}
+
+WordTree::WordTree(WordTree &&other) noexcept
+    : root(std::exchange(other.root, nullptr)), words(std::exchange(other.words, 0)) {}
+
+WordTree &WordTree::operator=(WordTree &&other) noexcept {
+    if (this != &other) {
+        if (root != nullptr) {
+            destroy(root);
+        }
+        root = std::exchange(other.root, nullptr);
+        words = std::exchange(other.words, 0);
+    }
+    return *this;
+}
+
+WordTree::~WordTree() {
+    if (root != nullptr) {
+        destroy(root);
+    }
+}
+
+WordTree::Node *WordTree::make_leaf(std::string_view suffix, size_t count) {
+    auto *leaf = new Node4();
+    leaf->prefix = suffix;
+    leaf->count = count;
+    return leaf;
+}
+
+void WordTree::destroy(Node *node) {
+    for_each_child(node, [](uint8_t, const Node *child) {
+      destroy(const_cast<Node *>(child));
+    });
+    delete_node(node);
+}
+
+// Frees the node itself, children must be already moved or destroyed.
+void WordTree::delete_node(Node *node) {
+    switch (node->type) {
+        case NODE4:
+            delete static_cast<Node4 *>(node);
+            break;
+        case NODE16:
+            delete static_cast<Node16 *>(node);
+            break;
+        case NODE48:
+            delete static_cast<Node48 *>(node);
+            break;
+        case NODE256:
+            delete static_cast<Node256 *>(node);
+            break;
+    }
+}
+
+WordTree::Node **WordTree::find_child(Node *node, uint8_t key) {
+    switch (node->type) {
+        case NODE4: {
+            auto *n = static_cast<Node4 *>(node);
+            for (size_t i = 0; i < n->children; ++i) {
+                if (n->keys[i] == key) {
+                    return &n->child[i];
+                }
+            }
+            return nullptr;
+        }
+        case NODE16: {
+            auto *n = static_cast<Node16 *>(node);
+#if defined(__SSE2__)
+            const auto keys = _mm_loadu_si128(reinterpret_cast<const __m128i *>(n->keys));
+            const auto cmp = _mm_cmpeq_epi8(keys, _mm_set1_epi8(static_cast<char>(key)));
+            const unsigned mask = _mm_movemask_epi8(cmp) & ((1U << n->children) - 1);
+            return mask != 0 ? &n->child[__builtin_ctz(mask)] : nullptr;
+#else
+            for (size_t i = 0; i < n->children; ++i) {
+                if (n->keys[i] == key) {
+                    return &n->child[i];
+                }
+            }
+            return nullptr;
+#endif
+        }
+        case NODE48: {
+            auto *n = static_cast<Node48 *>(node);
+            return n->index[key] != 0 ? &n->child[n->index[key] - 1] : nullptr;
+        }
+        case NODE256: {
+            auto *n = static_cast<Node256 *>(node);
+            return n->child[key] != nullptr ? &n->child[key] : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+template<class Small, class Large>
+static Large *grow_sorted(Small *node) {
+    auto *large = new Large();
+    large->children = node->children;
+    large->count = node->count;
+    large->prefix = std::move(node->prefix);
+    std::copy_n(node->keys, node->children, large->keys);
+    std::copy_n(node->child, node->children, large->child);
+    delete node;
+    return large;
+}
+
+void WordTree::add_child(Node *&node, uint8_t key, Node *child) {
+    switch (node->type) {
+        case NODE4:
+            if (node->children == 4) {
+                node = grow_sorted<Node4, Node16>(static_cast<Node4 *>(node));
+                break;
+            }
+            [[fallthrough]];
+        case NODE16: {
+            if (node->type == NODE16 && node->children == 16) {
+                auto *small = static_cast<Node16 *>(node);
+                auto *large = new Node48();
+                large->children = small->children;
+                large->count = small->count;
+                large->prefix = std::move(small->prefix);
+                for (size_t i = 0; i < small->children; ++i) {
+                    large->index[small->keys[i]] = static_cast<uint8_t>(i + 1);
+                    large->child[i] = small->child[i];
+                }
+                delete small;
+                node = large;
+            }
+            break;
+        }
+        case NODE48:
+            if (node->children == 48) {
+                auto *small = static_cast<Node48 *>(node);
+                auto *large = new Node256();
+                large->children = small->children;
+                large->count = small->count;
+                large->prefix = std::move(small->prefix);
+                for (size_t k = 0; k < 256; ++k) {
+                    if (small->index[k] != 0) {
+                        large->child[k] = small->child[small->index[k] - 1];
+                    }
+                }
+                delete small;
+                node = large;
+            }
+            break;
+        case NODE256:
+            break;
+    }
+
+    const auto insert_sorted = [&](uint8_t *keys, Node **children) {
+      const size_t count = node->children;
+      const size_t pos = std::upper_bound(keys, keys + count, key) - keys;
+      std::copy_backward(keys + pos, keys + count, keys + count + 1);
+      std::copy_backward(children + pos, children + count, children + count + 1);
+      keys[pos] = key;
+      children[pos] = child;
+    };
+
+    switch (node->type) {
+        case NODE4: {
+            auto *n = static_cast<Node4 *>(node);
+            insert_sorted(n->keys, n->child);
+            break;
+        }
+        case NODE16: {
+            auto *n = static_cast<Node16 *>(node);
+            insert_sorted(n->keys, n->child);
+            break;
+        }
+        case NODE48: {
+            // Children are never removed, so slots are filled densely.
+            auto *n = static_cast<Node48 *>(node);
+            n->child[n->children] = child;
+            n->index[key] = static_cast<uint8_t>(n->children + 1);
+            break;
+        }
+        case NODE256:
+            static_cast<Node256 *>(node)->child[key] = child;
+            break;
+    }
+    ++node->children;
+}
+
+// Cuts node prefix at common bytes, returns the new parent.
+WordTree::Node *WordTree::split(Node *node, size_t common) {
+    Node *parent = make_leaf(std::string_view(node->prefix).substr(0, common), 0);
+    const auto key = static_cast<uint8_t>(node->prefix[common]);
+    node->prefix.erase(0, common + 1);
+    add_child(parent, key, node);
+    return parent;
+}
+
+size_t &WordTree::operator[](std::string_view word) {
+    Node **slot = &root;
+    for (;;) {
+        if (*slot == nullptr) {
+            *slot = make_leaf(word, 0);
+            ++words;
+            return (*slot)->count;
+        }
+
+        const size_t common = common_prefix((*slot)->prefix, word);
+        if (common < (*slot)->prefix.size()) {
+            *slot = split(*slot, common);
+        }
+        word.remove_prefix(common);
+
+        Node *&node = *slot;
+        if (word.empty()) {
+            if (node->count == 0) {
+                ++words;
+            }
+            return node->count;
+        }
+
+        Node **child = find_child(node, static_cast<uint8_t>(word.front()));
+        if (child == nullptr) {
+            Node *leaf = make_leaf(word.substr(1), 0);
+            add_child(node, static_cast<uint8_t>(word.front()), leaf);
+            ++words;
+            return leaf->count;
+        }
+        slot = child;
+        word.remove_prefix(1);
+    }
+}
+
+size_t WordTree::get(std::string_view word) const {
+    const Node *node = root;
+    while (node != nullptr) {
+        if (!word.starts_with(node->prefix)) {
+            return 0;
+        }
+        word.remove_prefix(node->prefix.size());
+        if (word.empty()) {
+            return node->count;
+        }
+        Node **child = find_child(const_cast<Node *>(node), static_cast<uint8_t>(word.front()));
+        if (child == nullptr) {
+            return 0;
+        }
+        node = *child;
+        word.remove_prefix(1);
+    }
+    return 0;
+}
+
+// Returns number of words present in both subtrees.
+size_t WordTree::merge_nodes(Node *&target, Node *source) {
+    if (target == nullptr) {
+        target = source;
+        return 0;
+    }
+
+    size_t common = common_prefix(target->prefix, source->prefix);
+    if (common < target->prefix.size() && common < source->prefix.size()) {
+        // Paths diverge inside the prefixes: link both under a new parent.
+        target = split(target, common);
+        const auto key = static_cast<uint8_t>(source->prefix[common]);
+        source->prefix.erase(0, common + 1);
+        add_child(target, key, source);
+        return 0;
+    }
+
+    if (common < target->prefix.size()) {
+        // Target lies deeper than source, swap them
+        // to always descend from the shorter prefix.
+        std::swap(target, source);
+    }
+
+    if (common < source->prefix.size()) {
+        const auto key = static_cast<uint8_t>(source->prefix[common]);
+        source->prefix.erase(0, common + 1);
+        Node **child = find_child(target, key);
+        if (child != nullptr) {
+            return merge_nodes(*child, source);
+        }
+        add_child(target, key, source);
+        return 0;
+    }
+
+    size_t duplicates = (target->count != 0 && source->count != 0) ? 1 : 0;
+    target->count += source->count;
+    for_each_child(source, [&](uint8_t key, const Node *child) {
+      Node **existing = find_child(target, key);
+      if (existing != nullptr) {
+          duplicates += merge_nodes(*existing, const_cast<Node *>(child));
+      } else {
+          add_child(target, key, const_cast<Node *>(child));
+      }
+    });
+    delete_node(source);
+    return duplicates;
+}
+
+void WordTree::merge(WordTree &&other) {
+    if (other.root == nullptr) {
+        return;
+    }
+    words += other.words - merge_nodes(root, std::exchange(other.root, nullptr));
+    other.words = 0;
+}
+
+const WordTree::Node *WordTree::find_prefix(std::string_view prefix, std::string &path) const {
+    const Node *node = root;
+    while (node != nullptr) {
+        const size_t common = common_prefix(node->prefix, prefix);
+        if (common == prefix.size()) {
+            return node;
+        }
+        if (common < node->prefix.size()) {
+            return nullptr;
+        }
+        path += node->prefix;
+        prefix.remove_prefix(common);
+
+        Node **child = find_child(const_cast<Node *>(node), static_cast<uint8_t>(prefix.front()));
+        if (child == nullptr) {
+            return nullptr;
+        }
+        path.push_back(prefix.front());
+        prefix.remove_prefix(1);
+        node = *child;
+    }
+    return nullptr;
+}
+
+WordTree::PrefixCount WordTree::prefix_count(std::string_view prefix) const {
+    PrefixCount result;
+    for_each([&](std::string_view, size_t count) {
+      ++result.words;
+      result.total += count;
+    }, prefix);
+    return result;
+}
@@ -0,0 +1,170 @@
+#ifndef FREQ_SRC_WORD_TREE_H
+#define FREQ_SRC_WORD_TREE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Adaptive radix tree (ART) counting words.
+// Inner nodes grow from 4 to 16, 48 and 256 children and keep
+// a compressed path, so shared prefixes are stored only once.
+// Iteration visits words in lexicographical (byte) order,
+// hence alphabetical reports and prefix queries need no sort.
+class WordTree {
+ public:
+  WordTree() = default;
+  WordTree(const WordTree &) = delete;
+  WordTree &operator=(const WordTree &) = delete;
+  WordTree(WordTree &&other) noexcept;
+  WordTree &operator=(WordTree &&other) noexcept;
+  ~WordTree();
+
+  // Nothing to preallocate, kept to be interchangeable with FreqMap.
+  void reserve(size_t) {}
+
+  [[nodiscard]] size_t size() const {
+      return words;
+  }
+
+  [[nodiscard]] bool empty() const {
+      return words == 0;
+  }
+
+  // Inserts the word with zero count if it is missing.
+  size_t &operator[](std::string_view word);
+
+  // Returns count of the word, 0 if it was never added.
+  [[nodiscard]] size_t get(std::string_view word) const;
+
+  // Moves all nodes of other into this tree. Subtrees missing
+  // in this tree are linked as is, without visiting their words.
+  void merge(WordTree &&other);
+
+  struct PrefixCount {
+    size_t words = 0;
+    size_t total = 0;
+  };
+
+  // Number of distinct words starting with prefix and sum of their counts.
+  [[nodiscard]] PrefixCount prefix_count(std::string_view prefix) const;
+
+  // Calls f(word, count) for every word starting with prefix in lexicographical order.
+  template<class F>
+  void for_each(F &&f, std::string_view prefix = {}) const {
+      std::string path;
+      const Node *node = find_prefix(prefix, path);
+      if (node != nullptr) {
+          visit(node, path, f);
+      }
+  }
+
+ private:
+  enum NodeType : uint8_t { NODE4, NODE16, NODE48, NODE256 };
+
+  // A word ends in the node when count is not zero. Path from the
+  // parent is the byte the node is linked by followed by prefix.
+  struct Node {
+    NodeType type;
+    uint16_t children = 0;
+    size_t count = 0;
+    std::string prefix;
+
+    explicit Node(NodeType type) : type(type) {}
+  };
+
+  // Node4 and Node16 keep keys sorted.
+  struct Node4 : Node {
+    uint8_t keys[4]{};
+    Node *child[4]{};
+
+    Node4() : Node(NODE4) {}
+  };
+
+  struct Node16 : Node {
+    uint8_t keys[16]{};
+    Node *child[16]{};
+
+    Node16() : Node(NODE16) {}
+  };
+
+  // Node48 maps a key byte to 1-based position in child.
+  struct Node48 : Node {
+    uint8_t index[256]{};
+    Node *child[48]{};
+
+    Node48() : Node(NODE48) {}
+  };
+
+  struct Node256 : Node {
+    Node *child[256]{};
+
+    Node256() : Node(NODE256) {}
+  };
+
+  static Node *make_leaf(std::string_view suffix, size_t count);
+  static void destroy(Node *node);
+  static void delete_node(Node *node);
+  static Node **find_child(Node *node, uint8_t key);
+  static void add_child(Node *&node, uint8_t key, Node *child);
+  static Node *split(Node *node, size_t common);
+  size_t merge_nodes(Node *&target, Node *source);
+  const Node *find_prefix(std::string_view prefix, std::string &path) const;
+
+  template<class F>
+  static void for_each_child(const Node *node, F &&f) {
+      switch (node->type) {
+          case NODE4: {
+              const auto *n = static_cast<const Node4 *>(node);
+              for (size_t i = 0; i < n->children; ++i) {
+                  f(n->keys[i], n->child[i]);
+              }
+              break;
+          }
+          case NODE16: {
+              const auto *n = static_cast<const Node16 *>(node);
+              for (size_t i = 0; i < n->children; ++i) {
+                  f(n->keys[i], n->child[i]);
+              }
+              break;
+          }
+          case NODE48: {
+              const auto *n = static_cast<const Node48 *>(node);
+              for (size_t key = 0; key < 256; ++key) {
+                  if (n->index[key] != 0) {
+                      f(static_cast<uint8_t>(key), n->child[n->index[key] - 1]);
+                  }
+              }
+              break;
+          }
+          case NODE256: {
+              const auto *n = static_cast<const Node256 *>(node);
+              for (size_t key = 0; key < 256; ++key) {
+                  if (n->child[key] != nullptr) {
+                      f(static_cast<uint8_t>(key), n->child[key]);
+                  }
+              }
+              break;
+          }
+      }
+  }
+
+  template<class F>
+  static void visit(const Node *node, std::string &path, F &f) {
+      const size_t length = path.size();
+      path += node->prefix;
+      if (node->count != 0) {
+          f(std::string_view(path), node->count);
+      }
+      for_each_child(node, [&](uint8_t key, const Node *child) {
+        path.push_back(static_cast<char>(key));
+        visit(child, path, f);
+        path.pop_back();
+      });
+      path.resize(length);
+  }
+
+  Node *root = nullptr;
+  size_t words = 0;
+};
+
+#endif //FREQ_SRC_WORD_TREE_H